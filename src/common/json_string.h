@@ -0,0 +1,73 @@
+#ifndef _JSON_STRING_H_
+#define _JSON_STRING_H_
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string>
+
+// Length of the well-formed UTF-8 sequence at the start of s[0, n), or 0
+// if there is none: overlong forms, surrogates and code points past
+// U+10FFFF are rejected.
+inline size_t utf8_sequence_length(const unsigned char* s, size_t n) {
+  size_t len;
+  unsigned char lo = 0x80;  // range of the second byte
+  unsigned char hi = 0xbf;
+  if (s[0] < 0x80) {
+    return 1;
+  } else if (s[0] >= 0xc2 && s[0] <= 0xdf) {
+    len = 2;
+  } else if (s[0] >= 0xe0 && s[0] <= 0xef) {
+    len = 3;
+    lo = s[0] == 0xe0 ? 0xa0 : 0x80;
+    hi = s[0] == 0xed ? 0x9f : 0xbf;
+  } else if (s[0] >= 0xf0 && s[0] <= 0xf4) {
+    len = 4;
+    lo = s[0] == 0xf0 ? 0x90 : 0x80;
+    hi = s[0] == 0xf4 ? 0x8f : 0xbf;
+  } else {
+    return 0;
+  }
+
+  if (n < len || s[1] < lo || s[1] > hi) {
+    return 0;
+  }
+
+  for (size_t k = 2; k < len; ++k) {
+    if (s[k] < 0x80 || s[k] > 0xbf) {
+      return 0;
+    }
+  }
+
+  return len;
+}
+
+// Append s to out as a JSON string. Bytes that are not part of valid
+// UTF-8, e.g. from a path in another encoding, are escaped as the code
+// points of the same value, so the output is always valid JSON.
+inline void append_json_string(std::string* out, const std::string& s) {
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(s.data());
+  const size_t n = s.size();
+  out->push_back('"');
+  for (size_t i = 0; i < n;) {
+    unsigned char c = p[i];
+    size_t len = utf8_sequence_length(p + i, n - i);
+    if (c == '"' || c == '\\') {
+      out->push_back('\\');
+      out->push_back(c);
+    } else if (c < 0x20 || len == 0) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      out->append(buf);
+    } else {
+      out->append(s, i, len);
+      i += len;
+      continue;
+    }
+
+    ++i;
+  }
+
+  out->push_back('"');
+}
+
+#endif  // _JSON_STRING_H_
@@ -83,6 +83,48 @@ static void buf_stream_read(png_structp png, png_bytep buf, png_size_t size) {
   stream->offset += size;
 }
 
+// Ask libpng for 8 or 16-bit gray, gray + alpha, RGB or RGBA samples,
+// with 16-bit samples in host byte order, and fill in the image fields
+// that describe them. Returns false for images that cannot be converted.
+static bool setup_read_transforms(png_structp png_ptr, png_infop info_ptr,
+                                  PNGImage* image) {
+  png_byte color_type = png_get_color_type(png_ptr, info_ptr);
+  png_byte bit_depth = png_get_bit_depth(png_ptr, info_ptr);
+
+  if (color_type == PNG_COLOR_TYPE_PALETTE) {
+    png_set_palette_to_rgb(png_ptr);
+  }
+
+  if (color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8) {
+    png_set_expand_gray_1_2_4_to_8(png_ptr);
+  }
+
+  if (png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS)) {
+    png_set_tRNS_to_alpha(png_ptr);
+  }
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  if (bit_depth == 16) {
+    png_set_swap(png_ptr);  // PNG stores 16-bit samples MSB first
+  }
+#endif
+
+  png_read_update_info(png_ptr, info_ptr);
+
+  image->width = png_get_image_width(png_ptr, info_ptr);
+  image->height = png_get_image_height(png_ptr, info_ptr);
+  image->color_type = png_get_color_type(png_ptr, info_ptr);
+  image->bit_depth = png_get_bit_depth(png_ptr, info_ptr);
+  image->channels = png_get_channels(png_ptr, info_ptr);
+
+  if (image->bit_depth != 8 && image->bit_depth != 16) {
+    fprintf(stderr, "Error: unsupported bit depth: %d\n", image->bit_depth);
+    return false;
+  }
+
+  return true;
+}
+
 PNGImage read_png_from_memory(const png_bytep buf, png_size_t size) {
   // initialize stuff
   png_structp png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING,
@@ -115,23 +157,11 @@ PNGImage read_png_from_memory(const png_bytep buf, png_size_t size) {
 
   PNGImage image;
 
-  image.width = png_get_image_width(png_ptr, info_ptr);
-  image.height = png_get_image_height(png_ptr, info_ptr);
-  image.color_type = png_get_color_type(png_ptr, info_ptr);
-  image.bit_depth = png_get_bit_depth(png_ptr, info_ptr);
-
-  if (image.color_type == PNG_COLOR_TYPE_RGB) {
-    image.channels = 3;
-  } else if (image.color_type == PNG_COLOR_TYPE_RGBA) {
-    image.channels = 4;
-  } else {
-    fprintf(stderr, "Error: unsupported color type: %d\n", image.color_type);
+  if (!setup_read_transforms(png_ptr, info_ptr, &image)) {
     png_destroy_read_struct(&png_ptr, &info_ptr, nullptr);
     exit(1);
   }
 
-  png_read_update_info(png_ptr, info_ptr);
-
   // read file
   if (setjmp(png_jmpbuf(png_ptr))) {
     fprintf(stderr, "Error: error during read_image\n");
@@ -246,24 +276,12 @@ PNGImage read_png_file(const char* filename) {
 
   PNGImage image;
 
-  image.width = png_get_image_width(png_ptr, info_ptr);
-  image.height = png_get_image_height(png_ptr, info_ptr);
-  image.color_type = png_get_color_type(png_ptr, info_ptr);
-  image.bit_depth = png_get_bit_depth(png_ptr, info_ptr);
-
-  if (image.color_type == PNG_COLOR_TYPE_RGB) {
-    image.channels = 3;
-  } else if (image.color_type == PNG_COLOR_TYPE_RGBA) {
-    image.channels = 4;
-  } else {
-    fprintf(stderr, "Error: unsupported color type: %d\n", image.color_type);
+  if (!setup_read_transforms(png_ptr, info_ptr, &image)) {
     png_destroy_read_struct(&png_ptr, &info_ptr, nullptr);
     fclose(fp);
     exit(1);
   }
 
-  png_read_update_info(png_ptr, info_ptr);
-
   // read file
   if (setjmp(png_jmpbuf(png_ptr))) {
     fprintf(stderr, "Error: error during read_image\n");
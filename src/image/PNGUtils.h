@@ -5,6 +5,8 @@
 #include <png.h>
 #include <vector>
 
+// A decoded PNG: gray, gray + alpha, RGB or RGBA rows of 8 or 16-bit
+// samples, the latter in host byte order.
 typedef struct {
   std::vector<int8_t> data;
   int width;
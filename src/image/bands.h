@@ -0,0 +1,32 @@
+#ifndef _BANDS_H_
+#define _BANDS_H_
+
+#include <functional>
+#include <thread>
+#include <vector>
+
+// Run fn(t, begin, end) for `threads` bands of rows [0, rows), band 0 on
+// the calling thread.
+inline void for_each_band(int rows, int threads,
+                          const std::function<void(int, int, int)>& fn) {
+  if (threads > rows) {
+    threads = rows;
+  }
+
+  if (threads < 1) {
+    threads = 1;
+  }
+
+  std::vector<std::thread> workers;
+  for (int t = 1; t < threads; ++t) {
+    workers.push_back(std::thread(fn, t, rows * t / threads,
+                                  rows * (t + 1) / threads));
+  }
+
+  fn(0, 0, rows / threads);
+  for (auto& worker : workers) {
+    worker.join();
+  }
+}
+
+#endif  // _BANDS_H_
@@ -0,0 +1,11 @@
+#ifndef _CONTENT_HASH_H_
+#define _CONTENT_HASH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// XXH64 of n bytes: a fast, well-mixed 64-bit digest for telling whether
+// file contents changed. Not meant to resist deliberate collisions.
+uint64_t content_hash(const void* data, size_t n, uint64_t seed = 0);
+
+#endif  // _CONTENT_HASH_H_
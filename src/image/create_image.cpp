@@ -1,49 +1,397 @@
 // Copyright: This program is released into the public domain.
 
+// Generate synthetic test images: gradients, noise and checkerboards of
+// any size up to 16K, 8 or 16 bits deep, with 1, 3 or 4 channels. The
+// pixels depend only on the options and the seed, never on the number of
+// threads, so a corpus can be recreated exactly.
+
+#include <getopt.h>
+#include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
 #include <vector>
 #include <stdexcept>
 #include <opencv2/opencv.hpp>
+#include "bands.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+static const char* program = "create_image";
+static const char* version = "0.2.0";
+static const char* usage =
+    "Usage: %s [options] [output_file]\n"
+    "\n"
+    "Writes output.png by default. With -n, output_file is a printf\n"
+    "pattern such as noise_%%03d.png.\n"
+    "\n"
+    "Options:\n"
+    "  -h, --help                   Print this help message and exit\n"
+    "  -v, --version                Print version message and exit\n"
+    "  -p, --pattern <Name>         gradient (default), noise or checker\n"
+    "  -s, --size <Width>x<Height>  Image size, up to 16384x16384\n"
+    "                               (default: 640x480)\n"
+    "  -c, --channels <Number>      1, 3 or 4 (default: 4)\n"
+    "  -d, --depth <Bits>           8 or 16 (default: 8)\n"
+    "  -k, --cell <Pixels>          Checkerboard cell size (default: 64)\n"
+    "  -S, --seed <Number>          Noise seed (default: 0)\n"
+    "  -n, --count <Number>         Number of images; image i uses seed +\n"
+    "                               i (default: 1)\n"
+    "  -j, --jobs <Number>          Number of threads (default: number of\n"
+    "                               CPUs)\n"
+    "\n";
+
+static const int kMaxSize = 16384;
+
+typedef enum { kGradient, kNoise, kChecker } Pattern;
 
-#define clamp(x) cv::saturate_cast<uchar>(x)
+typedef struct {
+    Pattern pattern;
+    int width;
+    int height;
+    int channels;
+    int depth;
+    int cell;
+    uint32_t seed;
+    int jobs;
+} Config;
+
+// Integer hash with good avalanche (lowbias32 by Chris Wellons).
+static inline uint32_t hash32(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+#if defined(__SSE2__)
+// Lane-wise 32-bit multiply; SSE2 only multiplies the even lanes.
+static inline __m128i mullo32(__m128i a, __m128i b) {
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                              _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
 
-uchar lerp(int i, int range, uchar max) {
-    float ratio = static_cast<float>(i) / static_cast<float>(range);
-    return static_cast<uchar>(ratio * max);
+static inline __m128i hash32x4(__m128i x) {
+    x = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+    x = mullo32(x, _mm_set1_epi32(0x7feb352d));
+    x = _mm_xor_si128(x, _mm_srli_epi32(x, 15));
+    x = mullo32(x, _mm_set1_epi32(0x846ca68b));
+    return _mm_xor_si128(x, _mm_srli_epi32(x, 16));
 }
+#elif defined(__ARM_NEON)
+static inline uint32x4_t hash32x4(uint32x4_t x) {
+    x = veorq_u32(x, vshrq_n_u32(x, 16));
+    x = vmulq_n_u32(x, 0x7feb352du);
+    x = veorq_u32(x, vshrq_n_u32(x, 15));
+    x = vmulq_n_u32(x, 0x846ca68bu);
+    return veorq_u32(x, vshrq_n_u32(x, 16));
+}
+#endif
+
+// Fill n bytes with noise: bytes 4k to 4k + 3 are hash32(key + k), least
+// significant byte first.
+static void noise_row(uint8_t* p, size_t n, uint32_t key) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    __m128i k = _mm_add_epi32(_mm_set1_epi32(key), _mm_setr_epi32(0, 1, 2, 3));
+    for (; i + 16 <= n; i += 16) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p + i), hash32x4(k));
+        k = _mm_add_epi32(k, _mm_set1_epi32(4));
+    }
+#elif defined(__ARM_NEON)
+    static const uint32_t lanes[4] = {0, 1, 2, 3};
+    uint32x4_t k = vaddq_u32(vdupq_n_u32(key), vld1q_u32(lanes));
+    for (; i + 16 <= n; i += 16) {
+        vst1q_u8(p + i, vreinterpretq_u8_u32(hash32x4(k)));
+        k = vaddq_u32(k, vdupq_n_u32(4));
+    }
+#endif
+    for (; i < n; ++i) {
+        uint32_t w = hash32(key + static_cast<uint32_t>(i / 4));
+        p[i] = static_cast<uint8_t>(w >> (8 * (i % 4)));
+    }
+}
+
+// Blue at full scale, green rising down the image, red rising to the
+// right and alpha, or the only channel of a gray image, their average,
+// rounded half to even as cv::saturate_cast rounds 0.5 * (green + red).
+template <typename T, int cn>
+static void gradient_row(T* p, int cols, T max, T green, const T* ramp) {
+    for (int j = 0; j < cols; ++j, p += cn) {
+        T red = ramp[j];
+        int sum = green + red;
+        T average = static_cast<T>((sum >> 1) + (sum & (sum >> 1) & 1));
+        if (cn == 1) {
+            p[0] = average;
+            continue;
+        }
 
-void fill_image(cv::Mat* img) {
+        p[0] = max;
+        p[1] = green;
+        p[2] = red;
+        if (cn == 4) {
+            p[3] = average;
+        }
+    }
+}
+
+template <typename T>
+static void fill_gradient(cv::Mat* img, int jobs) {
+    cv::Mat& mat = *img;
+    const T max = static_cast<T>(sizeof(T) == 1 ? UCHAR_MAX : USHRT_MAX);
+    const int64_t cols = std::max(mat.cols - 1, 1);
+    const int64_t rows = std::max(mat.rows - 1, 1);
+    std::vector<T> ramp(mat.cols);
+    for (int j = 0; j < mat.cols; ++j) {
+        ramp[j] = static_cast<T>(j * max / cols);
+    }
+
+    for_each_band(mat.rows, jobs, [&](int, int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            T* p = mat.ptr<T>(i);
+            T green = static_cast<T>(i * max / rows);
+            if (mat.channels() == 1) {
+                gradient_row<T, 1>(p, mat.cols, max, green, ramp.data());
+            } else if (mat.channels() == 3) {
+                gradient_row<T, 3>(p, mat.cols, max, green, ramp.data());
+            } else {
+                gradient_row<T, 4>(p, mat.cols, max, green, ramp.data());
+            }
+        }
+    });
+}
+
+// White and black cells, opaque; only two distinct rows exist, so each
+// row is a copy of one of them.
+static void fill_checker(cv::Mat* img, int cell, int jobs) {
     cv::Mat& mat = *img;
-    for (int i = 0; i < mat.rows; ++i) {
+    const size_t pixel_bytes = mat.elemSize();
+    const size_t row_bytes = mat.cols * pixel_bytes;
+    std::vector<uint8_t> rows[2];
+    for (int phase = 0; phase < 2; ++phase) {
+        rows[phase].resize(row_bytes);
         for (int j = 0; j < mat.cols; ++j) {
-            cv::Vec4b& rgba = mat.at<cv::Vec4b>(i, j);
-            rgba[0] = UCHAR_MAX;  // blue
-            rgba[1] = clamp(lerp(i, mat.rows - 1, UCHAR_MAX));  // green
-            rgba[2] = clamp(lerp(j, mat.cols - 1, UCHAR_MAX));  // red
-            rgba[3] = clamp(0.5 * (rgba[1] + rgba[2]));  // alpha
+            bool white = ((j / cell) & 1) == phase;
+            memset(&rows[phase][j * pixel_bytes], white ? 0xff : 0,
+                   pixel_bytes);
+            if (mat.channels() == 4) {
+                // alpha is the last channel
+                memset(&rows[phase][(j + 1) * pixel_bytes - mat.elemSize1()],
+                       0xff, mat.elemSize1());
+            }
         }
     }
+
+    for_each_band(mat.rows, jobs, [&](int, int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            memcpy(mat.ptr(i), rows[(i / cell) & 1].data(), row_bytes);
+        }
+    });
 }
 
-int main(int argv, char** argc) {
-    const char* filename = "output.png";
+static void fill_noise(cv::Mat* img, uint32_t seed, int jobs) {
+    cv::Mat& mat = *img;
+    const size_t row_bytes = mat.cols * mat.elemSize();
+    for_each_band(mat.rows, jobs, [&](int, int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            uint32_t key = hash32(seed ^ hash32(static_cast<uint32_t>(i)));
+            noise_row(mat.ptr(i), row_bytes, key);
+        }
+    });
+}
 
-    // Create a 640x480 image with alpha channel
-    cv::Mat img(480, 640, CV_8UC4);  // initialized as transparent black
-    fill_image(&img);
+void fill_image(cv::Mat* img, const Config& config, uint32_t seed) {
+    if (config.pattern == kNoise) {
+        fill_noise(img, seed, config.jobs);
+    } else if (config.pattern == kChecker) {
+        fill_checker(img, config.cell, config.jobs);
+    } else if (config.depth == 16) {
+        fill_gradient<uint16_t>(img, config.jobs);
+    } else {
+        fill_gradient<uint8_t>(img, config.jobs);
+    }
+}
+
+static int parse_int(const char* str, int min, int max, const char* what) {
+    char* end = nullptr;
+    long v = strtol(str, &end, 10);
+    if (end == str || *end != '\0' || v < min || v > max) {
+        fprintf(stderr, "Error: invalid %s: %s\n", what, str);
+        exit(EXIT_FAILURE);
+    }
+
+    return static_cast<int>(v);
+}
+
+// Whether a file name pattern has exactly one conversion and it is an
+// int one such as %d or %03d, so it can be given to snprintf with the
+// image number. %% is allowed anywhere.
+static bool is_number_pattern(const char* pattern) {
+    int conversions = 0;
+    for (const char* p = pattern; *p != '\0'; ++p) {
+        if (*p != '%') {
+            continue;
+        }
+
+        if (*++p == '%') {
+            continue;
+        }
+
+        p += strspn(p, "-+ #0");
+        p += strspn(p, "0123456789");
+        if (*p == '.') {
+            p += 1 + strspn(p + 1, "0123456789");
+        }
+
+        if (*p != 'd' && *p != 'i') {
+            return false;
+        }
+
+        ++conversions;
+    }
+
+    return conversions == 1;
+}
+
+int main(int argc, char** argv) {
+    int show_help = 0;
+    int show_version = 0;
+    int count = 1;
+    Config config = {kGradient, 640, 480, 4, 8, 64, 0,
+                     static_cast<int>(std::max(1u,
+                         std::thread::hardware_concurrency()))};
+
+    static struct option long_options[] = {
+        {"help", no_argument, &show_help, 'h'},
+        {"version", no_argument, &show_version, 'v'},
+        {"pattern", required_argument, 0, 'p'},
+        {"size", required_argument, 0, 's'},
+        {"channels", required_argument, 0, 'c'},
+        {"depth", required_argument, 0, 'd'},
+        {"cell", required_argument, 0, 'k'},
+        {"seed", required_argument, 0, 'S'},
+        {"count", required_argument, 0, 'n'},
+        {"jobs", required_argument, 0, 'j'},
+        {0, 0, 0, 0}};
+
+    while (true) {
+        int opt = getopt_long(argc, argv, "hvp:s:c:d:k:S:n:j:", long_options,
+                              nullptr);
+        if (opt == -1) {
+            break;
+        } else if (opt == 'h') {
+            printf(usage, program);
+            exit(EXIT_SUCCESS);
+        } else if (opt == 'v') {
+            printf("%s version %s\n", program, version);
+            exit(EXIT_SUCCESS);
+        } else if (opt == 'p') {
+            if (strcmp(optarg, "gradient") == 0) {
+                config.pattern = kGradient;
+            } else if (strcmp(optarg, "noise") == 0) {
+                config.pattern = kNoise;
+            } else if (strcmp(optarg, "checker") == 0) {
+                config.pattern = kChecker;
+            } else {
+                fprintf(stderr, "Error: unknown pattern: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+        } else if (opt == 's') {
+            char end;
+            if (sscanf(optarg, "%dx%d%c", &config.width, &config.height,
+                       &end) != 2 ||
+                config.width < 1 || config.width > kMaxSize ||
+                config.height < 1 || config.height > kMaxSize) {
+                fprintf(stderr, "Error: invalid size: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+        } else if (opt == 'c') {
+            config.channels = parse_int(optarg, 1, 4, "number of channels");
+            if (config.channels == 2) {
+                fprintf(stderr, "Error: invalid number of channels: %s\n",
+                        optarg);
+                exit(EXIT_FAILURE);
+            }
+        } else if (opt == 'd') {
+            config.depth = parse_int(optarg, 8, 16, "depth");
+            if (config.depth != 8 && config.depth != 16) {
+                fprintf(stderr, "Error: invalid depth: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+        } else if (opt == 'k') {
+            config.cell = parse_int(optarg, 1, kMaxSize, "cell size");
+        } else if (opt == 'S') {
+            config.seed = static_cast<uint32_t>(strtoul(optarg, nullptr, 10));
+        } else if (opt == 'n') {
+            count = parse_int(optarg, 1, 1000000, "count");
+        } else if (opt == 'j') {
+            config.jobs = parse_int(optarg, 1, 1024, "number of jobs");
+        } else {  // 'h'
+            fprintf(stderr, usage, program);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (argc - optind > 1) {
+        fprintf(stderr, usage, program);
+        exit(EXIT_FAILURE);
+    }
+
+    const char* filename = optind < argc ? argv[optind] : "output.png";
+    if (count > 1 && !is_number_pattern(filename)) {
+        fprintf(stderr, "Error: %s must have exactly one %%d for the image "
+                "number\n", filename);
+        exit(EXIT_FAILURE);
+    }
+
+    const int type = CV_MAKETYPE(config.depth == 16 ? CV_16U : CV_8U,
+                                 config.channels);
+    cv::Mat img(config.height, config.width, type);
 
     std::vector<int> compression_params;
     compression_params.push_back(CV_IMWRITE_PNG_COMPRESSION);
     compression_params.push_back(9);
 
-    try {
-        cv::imwrite(filename, img, compression_params);
-    } catch (std::runtime_error& ex) {
-        fprintf(stderr, "Exception converting image to PNG format: %s\n",
-                ex.what());
-        return 1;
+    for (int i = 0; i < count; ++i) {
+        std::string name = filename;
+        if (count > 1) {
+            char buf[4096];
+            snprintf(buf, sizeof(buf), filename, i);
+            name = buf;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        fill_image(&img, config, config.seed + i);
+        double fill_ms = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count();
+
+        try {
+            if (!cv::imwrite(name, img, compression_params)) {
+                fprintf(stderr, "Error: cannot write %s\n", name.c_str());
+                return 3;
+            }
+        } catch (std::exception& ex) {
+            fprintf(stderr, "Exception converting image to %s: %s\n",
+                    name.c_str(), ex.what());
+            return 3;
+        }
+
+        fprintf(stdout, "Image saved to %s (generated in %.1f ms).\n",
+                name.c_str(), fill_ms);
     }
 
-    fprintf(stdout, "Image saved to %s.\n", filename);
     return 0;
 }
@@ -0,0 +1,220 @@
+#include <string.h>
+#include <vector>
+#include "bands.h"
+#include "equalize.h"
+
+#if defined(__AVX512VBMI__) && defined(__AVX512BW__)
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+void add_histogram(const uint8_t* p, size_t n, uint32_t hist[256]) {
+  // Runs of equal pixels would make every increment wait for the one
+  // before it; spreading neighbours over four tables breaks the chain.
+  uint32_t h[4][256];
+  memset(h, 0, sizeof(h));
+
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    uint64_t v;
+    memcpy(&v, p + i, 8);
+    ++h[0][v & 0xff];
+    ++h[1][(v >> 8) & 0xff];
+    ++h[2][(v >> 16) & 0xff];
+    ++h[3][(v >> 24) & 0xff];
+    ++h[0][(v >> 32) & 0xff];
+    ++h[1][(v >> 40) & 0xff];
+    ++h[2][(v >> 48) & 0xff];
+    ++h[3][v >> 56];
+  }
+
+  for (; i < n; ++i) {
+    ++h[0][p[i]];
+  }
+
+  for (int k = 0; k < 256; ++k) {
+    hist[k] += h[0][k] + h[1][k] + h[2][k] + h[3][k];
+  }
+}
+
+void equalize_lut(const uint32_t hist[256], uint8_t lut[256]) {
+  uint32_t total = 0;
+  for (int k = 0; k < 256; ++k) {
+    total += hist[k];
+  }
+
+  memset(lut, 0, 256);
+  if (total == 0) {
+    return;
+  }
+
+  int i = 0;
+  while (hist[i] == 0) {
+    ++i;
+  }
+
+  // a single value maps to itself
+  if (hist[i] == total) {
+    memset(lut, i, 256);
+    return;
+  }
+
+  // the same float arithmetic as cv::equalizeHist, so the tables match
+  float scale = (256 - 1.f) / (total - hist[i]);
+  uint32_t sum = 0;
+  for (lut[i++] = 0; i < 256; ++i) {
+    sum += hist[i];
+    lut[i] = cv::saturate_cast<uint8_t>(sum * scale);
+  }
+}
+
+void apply_lut(const uint8_t* src, uint8_t* dst, size_t n,
+               const uint8_t lut[256]) {
+  size_t i = 0;
+#if defined(__AVX512VBMI__) && defined(__AVX512BW__)
+  // the table fits in four registers: two 128-byte permutes look up the
+  // low 7 bits and the top bit picks one of them
+  const __m512i t0 = _mm512_loadu_si512(lut);
+  const __m512i t1 = _mm512_loadu_si512(lut + 64);
+  const __m512i t2 = _mm512_loadu_si512(lut + 128);
+  const __m512i t3 = _mm512_loadu_si512(lut + 192);
+  for (; i + 64 <= n; i += 64) {
+    __m512i x = _mm512_loadu_si512(src + i);
+    __m512i lo = _mm512_permutex2var_epi8(t0, x, t1);
+    __m512i hi = _mm512_permutex2var_epi8(t2, x, t3);
+    __m512i r = _mm512_mask_blend_epi8(_mm512_movepi8_mask(x), lo, hi);
+    _mm512_storeu_si512(dst + i, r);
+  }
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+  // a lookup in four registers covers 64 entries and gives 0 (tbl) or
+  // keeps the lane (tbx) for indices past them, so looking up the index
+  // minus 0, 64, 128 and 192 in each quarter of the table covers it all
+  uint8x16x4_t t[4];
+  for (int k = 0; k < 4; ++k) {
+    for (int j = 0; j < 4; ++j) {
+      t[k].val[j] = vld1q_u8(lut + 64 * k + 16 * j);
+    }
+  }
+
+  const uint8x16_t quarter = vdupq_n_u8(64);
+  for (; i + 16 <= n; i += 16) {
+    uint8x16_t x = vld1q_u8(src + i);
+    uint8x16_t r = vqtbl4q_u8(t[0], x);
+    x = vsubq_u8(x, quarter);
+    r = vqtbx4q_u8(r, t[1], x);
+    x = vsubq_u8(x, quarter);
+    r = vqtbx4q_u8(r, t[2], x);
+    x = vsubq_u8(x, quarter);
+    r = vqtbx4q_u8(r, t[3], x);
+    vst1q_u8(dst + i, r);
+  }
+#endif
+  for (; i < n; ++i) {
+    dst[i] = lut[src[i]];
+  }
+}
+
+// Y of BT.601 in the 14-bit fixed point of cv::cvtColor.
+static inline int luma(const uint8_t* p) {
+  return (p[0] * 1868 + p[1] * 9617 + p[2] * 4899 + (1 << 13)) >> 14;
+}
+
+static void add_luma_histogram(const uint8_t* p, size_t n, int cn,
+                               uint32_t hist[256]) {
+  uint32_t h[4][256];
+  memset(h, 0, sizeof(h));
+  for (size_t i = 0; i < n; ++i, p += cn) {
+    ++h[i & 3][luma(p)];
+  }
+
+  for (int k = 0; k < 256; ++k) {
+    hist[k] += h[0][k] + h[1][k] + h[2][k] + h[3][k];
+  }
+}
+
+// Replacing Y by lut[Y] while keeping Cr and Cb, which are scaled R - Y
+// and B - Y, adds the same lut[Y] - Y to B, G and R. So the pixel is
+// shifted in place, with no YCrCb round trip.
+static void apply_luma_lut(const uint8_t* src, uint8_t* dst, size_t n,
+                           int cn, const uint8_t lut[256]) {
+  for (size_t i = 0; i < n; ++i, src += cn, dst += cn) {
+    int y = luma(src);
+    int d = lut[y] - y;
+    for (int c = 0; c < 3; ++c) {
+      int v = src[c] + d;
+      dst[c] = static_cast<uint8_t>(v < 0 ? 0 : (v > 255 ? 255 : v));
+    }
+
+    if (cn == 4) {
+      dst[3] = src[3];
+    }
+  }
+}
+
+// The two passes shared by equalize_hist() and equalize_luma():
+// count(p, pixels, hist) over bands of rows, then apply(src, dst, pixels,
+// lut) over the same bands.
+template <typename Count, typename Apply>
+static void equalize_bands(const cv::Mat& src, cv::Mat* dst, int threads,
+                           Count count, Apply apply) {
+  dst->create(src.size(), src.type());
+  const bool continuous = src.isContinuous() && dst->isContinuous();
+  const size_t cols = src.cols;
+
+  // pass 1: one partial histogram per band
+  if (threads < 1) {
+    threads = 1;
+  }
+
+  std::vector<uint32_t> partial(static_cast<size_t>(threads) * 256, 0);
+  for_each_band(src.rows, threads, [&](int t, int begin, int end) {
+    uint32_t* hist = &partial[t * 256];
+    if (continuous) {
+      count(src.ptr(begin), (end - begin) * cols, hist);
+      return;
+    }
+
+    for (int y = begin; y < end; ++y) {
+      count(src.ptr(y), cols, hist);
+    }
+  });
+
+  uint32_t hist[256] = {0};
+  for (size_t k = 0; k < partial.size(); ++k) {
+    hist[k & 0xff] += partial[k];
+  }
+
+  uint8_t lut[256];
+  equalize_lut(hist, lut);
+
+  // pass 2: the same bands, while they are still in cache where possible
+  for_each_band(src.rows, threads, [&](int, int begin, int end) {
+    if (continuous) {
+      apply(src.ptr(begin), dst->ptr(begin), (end - begin) * cols, lut);
+      return;
+    }
+
+    for (int y = begin; y < end; ++y) {
+      apply(src.ptr(y), dst->ptr(y), cols, lut);
+    }
+  });
+}
+
+void equalize_hist(const cv::Mat& src, cv::Mat* dst, int threads) {
+  CV_Assert(src.type() == CV_8UC1);
+  equalize_bands(src, dst, threads, add_histogram, apply_lut);
+}
+
+void equalize_luma(const cv::Mat& src, cv::Mat* dst, int threads) {
+  CV_Assert(src.type() == CV_8UC3 || src.type() == CV_8UC4);
+  const int cn = src.channels();
+  equalize_bands(
+      src, dst, threads,
+      [cn](const uint8_t* p, size_t n, uint32_t* hist) {
+        add_luma_histogram(p, n, cn, hist);
+      },
+      [cn](const uint8_t* s, uint8_t* d, size_t n, const uint8_t* lut) {
+        apply_luma_lut(s, d, n, cn, lut);
+      });
+}
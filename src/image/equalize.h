@@ -0,0 +1,32 @@
+#ifndef _EQUALIZE_H_
+#define _EQUALIZE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <opencv2/core/core.hpp>
+
+// Histogram equalization of an 8-bit, 1-channel image, with exactly the
+// result of cv::equalizeHist. Each of `threads` threads counts a band of
+// rows into its own histogram; the partial histograms are summed into a
+// lookup table, which the same threads then apply to their bands.
+// src and dst may be the same Mat.
+void equalize_hist(const cv::Mat& src, cv::Mat* dst, int threads = 1);
+
+// Equalize only the luma of an 8-bit BGR or BGRA image: the histogram of
+// Y (BT.601, as in cv::COLOR_BGR2YCrCb) gives the table, and each pixel
+// is then shifted by lut[Y] - Y, which is what replacing Y and converting
+// back from YCrCb amounts to, up to rounding. Both passes compute Y on
+// the fly, so no intermediate image is made. Alpha is copied.
+void equalize_luma(const cv::Mat& src, cv::Mat* dst, int threads = 1);
+
+// Add the values of n bytes to hist.
+void add_histogram(const uint8_t* p, size_t n, uint32_t hist[256]);
+
+// The lookup table cv::equalizeHist builds from the histogram of an image.
+void equalize_lut(const uint32_t hist[256], uint8_t lut[256]);
+
+// dst[i] = lut[src[i]] for n bytes; src and dst may be the same.
+void apply_lut(const uint8_t* src, uint8_t* dst, size_t n,
+               const uint8_t lut[256]);
+
+#endif  // _EQUALIZE_H_
@@ -0,0 +1,147 @@
+#include "bands.h"
+#include "gray.h"
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// 14-bit fixed-point weights of B, G and R.
+static const int kWeights[2][3] = {
+  {1868, 9617, 4899},   // 0.114, 0.587, 0.299
+  {1183, 11718, 3483},  // 0.0722, 0.7152, 0.2126
+};
+
+#if defined(__SSE2__)
+// Gray values, as 32-bit lanes, of 4 pixels in 32-bit lanes B G R x.
+static inline __m128i gray4(__m128i v, __m128i w_br, __m128i w_g) {
+  // 16-bit lanes B R B R ... and G x G x ..., so that two multiply-adds
+  // give B * wb + R * wr and G * wg
+  __m128i br = _mm_and_si128(v, _mm_set1_epi16(0xff));
+  __m128i gx = _mm_srli_epi16(v, 8);
+  __m128i sum = _mm_add_epi32(_mm_madd_epi16(br, w_br),
+                              _mm_madd_epi16(gx, w_g));
+  return _mm_srli_epi32(_mm_add_epi32(sum, _mm_set1_epi32(1 << 13)), 14);
+}
+
+// Spread the 4 pixels of 3 bytes at the start of v to 32-bit lanes.
+static inline __m128i spread4(__m128i v) {
+#if defined(__SSSE3__)
+  return _mm_shuffle_epi8(v, _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1,
+                                           6, 7, 8, -1, 9, 10, 11, -1));
+#else
+  __m128i p01 = _mm_unpacklo_epi32(v, _mm_srli_si128(v, 3));
+  __m128i p23 = _mm_unpacklo_epi32(_mm_srli_si128(v, 6),
+                                   _mm_srli_si128(v, 9));
+  return _mm_unpacklo_epi64(p01, p23);
+#endif
+}
+#elif defined(__ARM_NEON)
+static inline uint16x4_t gray4(uint16x4_t b, uint16x4_t g, uint16x4_t r,
+                               const int* w) {
+  uint32x4_t sum = vmull_n_u16(b, w[0]);
+  sum = vmlal_n_u16(sum, g, w[1]);
+  sum = vmlal_n_u16(sum, r, w[2]);
+  return vrshrn_n_u32(sum, 14);
+}
+
+static inline uint8x8_t gray8(uint8x8_t b, uint8x8_t g, uint8x8_t r,
+                              const int* w) {
+  uint16x8_t b16 = vmovl_u8(b);
+  uint16x8_t g16 = vmovl_u8(g);
+  uint16x8_t r16 = vmovl_u8(r);
+  uint16x4_t lo = gray4(vget_low_u16(b16), vget_low_u16(g16),
+                        vget_low_u16(r16), w);
+  uint16x4_t hi = gray4(vget_high_u16(b16), vget_high_u16(g16),
+                        vget_high_u16(r16), w);
+  return vmovn_u16(vcombine_u16(lo, hi));
+}
+#endif
+
+void bgr_to_gray(const uint8_t* src, uint8_t* dst, size_t n, int cn,
+                 GrayStandard standard) {
+  const int* w = kWeights[standard];
+  size_t i = 0;
+#if defined(__SSE2__)
+  const __m128i w_br = _mm_set1_epi32((w[2] << 16) | w[0]);
+  const __m128i w_g = _mm_set1_epi32(w[1]);
+  if (cn == 3) {
+    for (; i + 16 <= n; i += 16) {
+      const uint8_t* p = src + 3 * i;
+      __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+      __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16));
+      __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 32));
+      // pixels 0, 4, 8 and 12 start at bytes 0, 12, 24 and 36
+      __m128i y0 = gray4(spread4(a), w_br, w_g);
+      __m128i y1 = gray4(spread4(_mm_or_si128(_mm_srli_si128(a, 12),
+                                              _mm_slli_si128(b, 4))),
+                         w_br, w_g);
+      __m128i y2 = gray4(spread4(_mm_or_si128(_mm_srli_si128(b, 8),
+                                              _mm_slli_si128(c, 8))),
+                         w_br, w_g);
+      __m128i y3 = gray4(spread4(_mm_srli_si128(c, 4)), w_br, w_g);
+      __m128i y = _mm_packus_epi16(_mm_packs_epi32(y0, y1),
+                                   _mm_packs_epi32(y2, y3));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), y);
+    }
+  } else if (cn == 4) {
+    for (; i + 16 <= n; i += 16) {
+      const __m128i* p = reinterpret_cast<const __m128i*>(src + 4 * i);
+      __m128i y0 = gray4(_mm_loadu_si128(p), w_br, w_g);
+      __m128i y1 = gray4(_mm_loadu_si128(p + 1), w_br, w_g);
+      __m128i y2 = gray4(_mm_loadu_si128(p + 2), w_br, w_g);
+      __m128i y3 = gray4(_mm_loadu_si128(p + 3), w_br, w_g);
+      __m128i y = _mm_packus_epi16(_mm_packs_epi32(y0, y1),
+                                   _mm_packs_epi32(y2, y3));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), y);
+    }
+  }
+#elif defined(__ARM_NEON)
+  if (cn == 3) {
+    for (; i + 16 <= n; i += 16) {
+      uint8x16x3_t px = vld3q_u8(src + 3 * i);
+      uint8x8_t lo = gray8(vget_low_u8(px.val[0]), vget_low_u8(px.val[1]),
+                           vget_low_u8(px.val[2]), w);
+      uint8x8_t hi = gray8(vget_high_u8(px.val[0]), vget_high_u8(px.val[1]),
+                           vget_high_u8(px.val[2]), w);
+      vst1q_u8(dst + i, vcombine_u8(lo, hi));
+    }
+  } else if (cn == 4) {
+    for (; i + 16 <= n; i += 16) {
+      uint8x16x4_t px = vld4q_u8(src + 4 * i);
+      uint8x8_t lo = gray8(vget_low_u8(px.val[0]), vget_low_u8(px.val[1]),
+                           vget_low_u8(px.val[2]), w);
+      uint8x8_t hi = gray8(vget_high_u8(px.val[0]), vget_high_u8(px.val[1]),
+                           vget_high_u8(px.val[2]), w);
+      vst1q_u8(dst + i, vcombine_u8(lo, hi));
+    }
+  }
+#endif
+  for (const uint8_t* p = src + cn * i; i < n; ++i, p += cn) {
+    dst[i] = static_cast<uint8_t>(
+        (p[0] * w[0] + p[1] * w[1] + p[2] * w[2] + (1 << 13)) >> 14);
+  }
+}
+
+void convert_to_gray(const cv::Mat& src, cv::Mat* dst,
+                     GrayStandard standard, int threads) {
+  CV_Assert(src.type() == CV_8UC3 || src.type() == CV_8UC4);
+  dst->create(src.size(), CV_8UC1);
+  const int cn = src.channels();
+  const size_t cols = src.cols;
+  const bool continuous = src.isContinuous() && dst->isContinuous();
+  for_each_band(src.rows, threads, [&](int, int begin, int end) {
+    if (continuous) {
+      bgr_to_gray(src.ptr(begin), dst->ptr(begin), (end - begin) * cols, cn,
+                  standard);
+      return;
+    }
+
+    for (int y = begin; y < end; ++y) {
+      bgr_to_gray(src.ptr(y), dst->ptr(y), cols, cn, standard);
+    }
+  });
+}
@@ -0,0 +1,27 @@
+#ifndef _GRAY_H_
+#define _GRAY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <opencv2/core/core.hpp>
+
+// Weights of B, G and R in the luma of a standard.
+typedef enum {
+  kBT601,  // SD video and JPEG; what cv::COLOR_BGR2GRAY uses
+  kBT709,  // HD video
+} GrayStandard;
+
+// Convert n BGR (cn == 3) or BGRA (cn == 4) pixels to gray, as
+// (B * wb + G * wg + R * wr + 2^13) >> 14 with weights summing to 2^14.
+// For kBT601 this is the arithmetic of cv::cvtColor.
+void bgr_to_gray(const uint8_t* src, uint8_t* dst, size_t n, int cn,
+                 GrayStandard standard);
+
+// Convert an 8-bit BGR or BGRA image into dst, splitting the rows among
+// `threads` threads. If dst already has the size of src and type
+// CV_8UC1, its memory is written in place, so a caller converting many
+// images can hand in the same buffer every time.
+void convert_to_gray(const cv::Mat& src, cv::Mat* dst,
+                     GrayStandard standard, int threads = 1);
+
+#endif  // _GRAY_H_
@@ -1,6 +1,7 @@
 // Copyright: This program is released into the public domain.
 
-// Convert an image file to PPM format.
+// Convert an image file to PPM format
+// (PGM for gray, PAM for images with alpha).
 // Refer to:
 // https://en.wikipedia.org/wiki/Netpbm_format
 
@@ -20,12 +21,14 @@ static const char* usage =
     "Options:\n"
     "  -h, --help                   Print this help message and exit\n"
     "  -v, --version                Print version message and exit\n"
-    "  -A, --ascii                  Use the ASCII (P3) format\n"
+    "  -A, --ascii                  Use the ASCII (P2/P3) format\n"
     "  -H, --headless               Do not write the file header\n"
+    "  -j, --jobs <Number>          Format ASCII output with N threads\n"
     "\n";
 
 static bool binary = true;
 static bool headless = false;
+static int jobs = 1;
 
 int main(int argc, char** argv) {
   int show_help = 0;
@@ -35,10 +38,11 @@ int main(int argc, char** argv) {
       {"help", no_argument, &show_help, 'h'},
       {"version", no_argument, &show_version, 'v'},
       {"ascii", no_argument, 0, 'A'},
+      {"jobs", required_argument, 0, 'j'},
       {0, 0, 0, 0}};
 
   while (true) {
-    int opt = getopt_long(argc, argv, "hvAH", long_options, nullptr);
+    int opt = getopt_long(argc, argv, "hvAHj:", long_options, nullptr);
     if (opt == -1) {
       break;
     } else if (opt == 'h') {
@@ -51,6 +55,12 @@ int main(int argc, char** argv) {
       binary = false;
     } else if (opt == 'H') {
       headless = true;
+    } else if (opt == 'j') {
+      jobs = atoi(optarg);
+      if (jobs < 1) {
+        fprintf(stderr, "Error: invalid number of jobs: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
     } else {  // 'h'
       fprintf(stderr, usage, program);
       exit(EXIT_FAILURE);
@@ -65,16 +75,22 @@ int main(int argc, char** argv) {
   const char* input_file = argv[optind++];
   const char* output_file = argv[optind++];
 
-  cv::Mat bgr_image = cv::imread(input_file, cv::IMREAD_COLOR);
+  // keep the source depth and alpha channel
+  cv::Mat bgr_image = cv::imread(input_file, cv::IMREAD_UNCHANGED);
   if (bgr_image.empty()) {  // see [1]
     fprintf(stderr, "Error: cannot open file %s\n", input_file);
     exit(2);
   }
 
-  cv::Mat rgb_image;
-  cv::cvtColor(bgr_image, rgb_image, cv::COLOR_BGR2RGB);
-  int width = rgb_image.cols;
-  int height = rgb_image.rows;
+  if (bgr_image.depth() != CV_8U && bgr_image.depth() != CV_16U) {
+    fprintf(stderr, "Error: unsupported sample depth in %s\n", input_file);
+    exit(2);
+  }
+
+  // write_ppm reorders BGR(A) to RGB(A) while writing
+  PPMLayout layout = {bgr_image.cols, bgr_image.rows, bgr_image.channels(),
+                      bgr_image.depth() == CV_16U ? 16 : 8, bgr_image.step,
+                      true};
 
   FILE* fout = fopen(output_file, "wb");
   if (fout == nullptr) {
@@ -83,8 +99,11 @@ int main(int argc, char** argv) {
     exit(3);
   }
 
-  write_ppm(fout, (uint8_t*)rgb_image.data, width, height, headless, binary);
+  int ret = write_ppm(fout, bgr_image.data, layout, headless, binary, jobs);
   fclose(fout);
+  if (ret != 0) {
+    exit(4);
+  }
 
   return 0;
 }
@@ -0,0 +1,179 @@
+#include <math.h>
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+#include "bands.h"
+#include "mat_stats.h"
+
+// The histogram bin of a value of each depth.
+static inline int bin_of(uint8_t v) { return v; }
+static inline int bin_of(int8_t v) { return v + 128; }
+static inline int bin_of(uint16_t v) { return v >> 8; }
+static inline int bin_of(int16_t v) { return (v + 32768) >> 8; }
+static inline int bin_of(int32_t v) {
+  return (static_cast<uint32_t>(v) ^ 0x80000000u) >> 24;
+}
+static inline int bin_of(double v) {
+  if (v <= 0) {
+    return 0;
+  }
+
+  return v >= 1 ? kStatsBins - 1 : static_cast<int>(v * kStatsBins);
+}
+
+// What one thread has seen of one channel. The sums are of the values
+// minus the first one the thread saw, so that they stay small next to the
+// spread of the values: sum_squares / count - mean^2 would otherwise
+// cancel out for large values with a small spread. Sums of values up to
+// 16 bits are exact integers.
+template <typename T>
+struct Partial {
+  typedef typename std::conditional<std::is_integral<T>::value &&
+                                        sizeof(T) <= 2,
+                                    int64_t, double>::type Sum;
+  T min;
+  T max;
+  Sum reference;
+  Sum sum;
+  Sum sum_squares;
+  int64_t count;
+  int64_t nan_count;
+  int64_t inf_count;
+  int64_t histogram[kStatsBins];
+};
+
+template <typename T>
+static void accumulate(const T* p, size_t pixels, int cn, Partial<T>* acc) {
+  typedef typename Partial<T>::Sum Sum;
+  for (size_t i = 0; i < pixels; ++i) {
+    for (int c = 0; c < cn; ++c) {
+      T v = *p++;
+      Partial<T>& a = acc[c];
+      if (std::is_floating_point<T>::value && !std::isfinite(v)) {
+        ++(v != v ? a.nan_count : a.inf_count);
+        continue;
+      }
+
+      if (a.count++ == 0) {
+        a.reference = v;
+      }
+
+      a.min = std::min(a.min, v);
+      a.max = std::max(a.max, v);
+      Sum d = static_cast<Sum>(v) - a.reference;
+      a.sum += d;
+      a.sum_squares += d * d;
+      ++a.histogram[bin_of(v)];
+    }
+  }
+}
+
+template <typename T>
+static void compute(const cv::Mat& image, std::vector<ChannelStats>* stats,
+                    int threads) {
+  const int cn = image.channels();
+  const size_t cols = image.cols;
+  if (threads < 1) {
+    threads = 1;
+  }
+
+  std::vector<Partial<T>> partial(static_cast<size_t>(threads) * cn,
+                                  Partial<T>());
+  for (auto& a : partial) {
+    a.min = std::numeric_limits<T>::max();
+    a.max = std::numeric_limits<T>::lowest();
+  }
+
+  for_each_band(image.rows, threads, [&](int t, int begin, int end) {
+    Partial<T>* acc = &partial[t * cn];
+    if (image.isContinuous()) {
+      accumulate(image.ptr<T>(begin), (end - begin) * cols, cn, acc);
+      return;
+    }
+
+    for (int y = begin; y < end; ++y) {
+      accumulate(image.ptr<T>(y), cols, cn, acc);
+    }
+  });
+
+  stats->assign(cn, ChannelStats());
+  for (int c = 0; c < cn; ++c) {
+    ChannelStats& s = (*stats)[c];
+    Partial<T> total = partial[c];
+    double mean = 0;
+    double m2 = 0;  // sum of squared differences from the mean
+    int64_t merged = 0;
+    for (int t = 0; t < threads; ++t) {
+      const Partial<T>& a = partial[t * cn + c];
+      if (t > 0) {
+        total.min = std::min(total.min, a.min);
+        total.max = std::max(total.max, a.max);
+        total.count += a.count;
+        total.nan_count += a.nan_count;
+        total.inf_count += a.inf_count;
+        for (int k = 0; k < kStatsBins; ++k) {
+          total.histogram[k] += a.histogram[k];
+        }
+      }
+
+      if (a.count == 0) {
+        continue;
+      }
+
+      // merge the mean and m2 of this band into those of the bands before
+      // it (Chan et al.)
+      const double sum = static_cast<double>(a.sum);
+      const double band_mean = a.reference + sum / a.count;
+      const double band_m2 = std::max(
+          0.0, static_cast<double>(a.sum_squares) - sum * sum / a.count);
+      const int64_t n = merged + a.count;
+      const double delta = band_mean - mean;
+      mean += delta * a.count / n;
+      m2 += band_m2 + delta * delta * merged / n * a.count;
+      merged = n;
+    }
+
+    s.nan_count = total.nan_count;
+    s.inf_count = total.inf_count;
+    s.count = total.count;
+    s.histogram.assign(total.histogram, total.histogram + kStatsBins);
+    if (s.count == 0) {
+      s.min = s.max = s.mean = s.stddev = 0;
+      continue;
+    }
+
+    s.min = total.min;
+    s.max = total.max;
+    s.mean = mean;
+    s.stddev = sqrt(m2 / s.count);
+  }
+}
+
+bool compute_stats(const cv::Mat& image, std::vector<ChannelStats>* stats,
+                   int threads) {
+  switch (image.depth()) {
+    case CV_8U:
+      compute<uint8_t>(image, stats, threads);
+      return true;
+    case CV_8S:
+      compute<int8_t>(image, stats, threads);
+      return true;
+    case CV_16U:
+      compute<uint16_t>(image, stats, threads);
+      return true;
+    case CV_16S:
+      compute<int16_t>(image, stats, threads);
+      return true;
+    case CV_32S:
+      compute<int32_t>(image, stats, threads);
+      return true;
+    case CV_32F:
+      compute<float>(image, stats, threads);
+      return true;
+    case CV_64F:
+      compute<double>(image, stats, threads);
+      return true;
+    default:
+      return false;
+  }
+}
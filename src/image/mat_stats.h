@@ -0,0 +1,33 @@
+#ifndef _MAT_STATS_H_
+#define _MAT_STATS_H_
+
+#include <stdint.h>
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+// Number of histogram bins per channel.
+static const int kStatsBins = 256;
+
+// Statistics of one channel. NaN and infinite values are only counted;
+// min, max, mean, stddev and the histogram are over the finite ones.
+typedef struct {
+  double min;
+  double max;
+  double mean;
+  double stddev;
+  int64_t count;      // finite values
+  int64_t nan_count;
+  int64_t inf_count;
+  // kStatsBins equal bins over the range of the depth: [0, 256) for
+  // CV_8U, [-32768, 32768) for CV_16S and so on; [0, 1] for CV_32F and
+  // CV_64F, with values outside it counted in the first or last bin.
+  std::vector<int64_t> histogram;
+} ChannelStats;
+
+// Compute the statistics of every channel of an image in a single pass
+// over its pixels, which `threads` threads split by rows. Returns false
+// for a depth other than CV_8U to CV_64F.
+bool compute_stats(const cv::Mat& image, std::vector<ChannelStats>* stats,
+                   int threads = 1);
+
+#endif  // _MAT_STATS_H_
@@ -1,6 +1,7 @@
 // Copyright: This program is released into the public domain.
 
-// Convert a png image file to PPM format.
+// Convert a png image file to PPM format
+// (PGM for gray, PAM for images with alpha).
 // Refer to:
 // https://en.wikipedia.org/wiki/Netpbm_format
 
@@ -23,12 +24,14 @@ static const char* usage =
     "Options:\n"
     "  -h, --help                   Print this help message and exit\n"
     "  -v, --version                Print version message and exit\n"
-    "  -A, --ascii                  Use the ASCII (P3) format\n"
+    "  -A, --ascii                  Use the ASCII (P2/P3) format\n"
     "  -H, --headless               Do not write the file header\n"
+    "  -j, --jobs <Number>          Format ASCII output with N threads\n"
     "\n";
 
 static bool binary = true;
 static bool headless = false;
+static int jobs = 1;
 
 int main(int argc, char** argv) {
   int show_help = 0;
@@ -38,10 +41,11 @@ int main(int argc, char** argv) {
       {"help", no_argument, &show_help, 'h'},
       {"version", no_argument, &show_version, 'v'},
       {"ascii", no_argument, 0, 'A'},
+      {"jobs", required_argument, 0, 'j'},
       {0, 0, 0, 0}};
 
   while (true) {
-    int opt = getopt_long(argc, argv, "hvAH", long_options, nullptr);
+    int opt = getopt_long(argc, argv, "hvAHj:", long_options, nullptr);
     if (opt == -1) {
       break;
     } else if (opt == 'h') {
@@ -54,6 +58,12 @@ int main(int argc, char** argv) {
       binary = false;
     } else if (opt == 'H') {
       headless = true;
+    } else if (opt == 'j') {
+      jobs = atoi(optarg);
+      if (jobs < 1) {
+        fprintf(stderr, "Error: invalid number of jobs: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
     } else {  // 'h'
       fprintf(stderr, usage, program);
       exit(EXIT_FAILURE);
@@ -77,8 +87,14 @@ int main(int argc, char** argv) {
     exit(3);
   }
 
-  write_ppm(fout, (uint8_t*)image.data.data(), image.width, image.height, headless, binary);
+  PPMLayout layout = {image.width, image.height, image.channels,
+                      image.bit_depth};
+  int ret = write_ppm(fout, (uint8_t*)image.data.data(), layout, headless,
+                      binary, jobs);
   fclose(fout);
+  if (ret != 0) {
+    exit(4);
+  }
 
   return 0;
 }
@@ -2,31 +2,159 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
+#include <thread>
+#include <vector>
 #include "ppm.h"
 
-int write_ppm_data_ascii(FILE* f, uint8_t* data, int w, int h) {
-  for (int i = 0; i < h; ++i) {
-    for (int j = 0; j < w; ++j) {
-      int offset = (i * w + j) * 3;
-      int r = data[offset + 0];
-      int g = data[offset + 1];
-      int b = data[offset + 2];
-      int ret = fprintf(f, "%d %d %d\n", r, g, b);
-      if (ret < 0) {
-        fprintf(stderr, "Error: write error: %s\n", strerror(errno));
-        return 1;
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#define HAVE_BYTE_SHUFFLE 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#if defined(__GNUC__)
+// Without -march=native the build only assumes SSE2, so the byte shuffle
+// is compiled for SSSE3 on its own and used if the CPU has it.
+#include <tmmintrin.h>
+#define HAVE_BYTE_SHUFFLE 1
+#define BYTE_SHUFFLE_AT_RUNTIME 1
+#endif
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#if defined(__aarch64__)
+#define HAVE_BYTE_SHUFFLE 1
+#endif
+#endif
+
+// Upper bound of the text produced for one sample: "65535 ".
+static const size_t kMaxAsciiSampleBytes = 6;
+
+// Size of the text buffers that are filled before each fwrite.
+static const size_t kChunkBytes = 1 << 20;
+
+// Size of the buffer that binary samples are reordered into; small
+// enough to stay in L2 between the reordering pass and fwrite.
+static const size_t kSwizzleChunkBytes = 256 << 10;
+
+// Decimal text of every 8-bit sample, followed by a space.
+// Each entry is copied with a single 4-byte store; len tells how many
+// of those bytes (digits + space) are significant.
+struct AsciiSample {
+  char text[4];
+  uint8_t len;
+};
+
+static AsciiSample ascii_table[256];
+
+// "00", "01", ..., "99", used to format 16-bit samples two digits at a time.
+static char digit_pairs[200];
+
+static bool init_ascii_tables() {
+  for (int v = 0; v < 256; ++v) {
+    AsciiSample& s = ascii_table[v];
+    memset(s.text, ' ', sizeof(s.text));
+    s.len = snprintf(s.text, sizeof(s.text), "%d", v);
+    s.text[s.len++] = ' ';
+  }
+
+  for (int v = 0; v < 100; ++v) {
+    digit_pairs[2 * v] = '0' + v / 10;
+    digit_pairs[2 * v + 1] = '0' + v % 10;
+  }
+
+  return true;
+}
+
+static inline char* format_sample_ascii(char* p, uint8_t v) {
+  const AsciiSample& s = ascii_table[v];
+  memcpy(p, s.text, 4);
+  return p + s.len;
+}
+
+static inline char* format_sample_ascii(char* p, uint16_t v) {
+  char digits[5];
+  char* q = digits + sizeof(digits);
+  unsigned n = v;
+  while (n >= 100) {
+    q -= 2;
+    memcpy(q, digit_pairs + 2 * (n % 100), 2);
+    n /= 100;
+  }
+
+  if (n >= 10) {
+    q -= 2;
+    memcpy(q, digit_pairs + 2 * n, 2);
+  } else {
+    *--q = '0' + n;
+  }
+
+  size_t len = digits + sizeof(digits) - q;
+  memcpy(p, q, len);
+  p[len] = ' ';
+  return p + len + 1;
+}
+
+static size_t row_stride(const PPMLayout& layout) {
+  if (layout.stride != 0) {
+    return layout.stride;
+  }
+
+  return (size_t)layout.width * layout.channels * (layout.depth / 8);
+}
+
+// Index of the source channel that goes to output channel k.
+static int source_channel(const PPMLayout& layout, int k) {
+  if (layout.bgr && layout.channels >= 3 && k < 3) {
+    return 2 - k;
+  }
+
+  return k;
+}
+
+// Format rows [begin, end) into buf, one pixel per line, samples
+// separated by spaces. buf must hold at least
+// (end - begin) * w * c * kMaxAsciiSampleBytes + 4 bytes.
+// Returns the number of bytes written.
+template <typename T>
+static size_t format_rows_ascii(char* buf, const uint8_t* data,
+                                const PPMLayout& layout, int begin, int end) {
+  const int c = layout.channels;
+  const size_t stride = row_stride(layout);
+  int order[4];
+  for (int k = 0; k < c; ++k) {
+    order[k] = source_channel(layout, k);
+  }
+
+  char* p = buf;
+  for (int i = begin; i < end; ++i) {
+    const T* src = reinterpret_cast<const T*>(data + i * stride);
+    const T* src_end = src + (size_t)layout.width * c;
+    if (c == 3) {
+      const int r = order[0];
+      const int b = order[2];
+      for (; src < src_end; src += 3) {
+        p = format_sample_ascii(p, src[r]);
+        p = format_sample_ascii(p, src[1]);
+        p = format_sample_ascii(p, src[b]);
+        p[-1] = '\n';  // replace the trailing space
+      }
+    } else {
+      for (; src < src_end; src += c) {
+        for (int k = 0; k < c; ++k) {
+          p = format_sample_ascii(p, src[order[k]]);
+        }
+
+        p[-1] = '\n';
       }
     }
   }
 
-  return 0;
+  return p - buf;
 }
 
-int write_ppm_data_binary(FILE* f, uint8_t* data, int w, int h) {
-  int data_size = w * h * 3;
-  int bytes = fwrite(data, 1, data_size, f);
-  if (bytes < data_size) {
-    fprintf(stderr, "Error: incomplete write: %d/%d: %s\n", bytes, data_size,
+static int write_buffer(FILE* f, const void* buf, size_t size) {
+  size_t bytes = fwrite(buf, 1, size, f);
+  if (bytes < size) {
+    fprintf(stderr, "Error: incomplete write: %zu/%zu: %s\n", bytes, size,
             strerror(errno));
     return 1;
   }
@@ -34,21 +162,297 @@ int write_ppm_data_binary(FILE* f, uint8_t* data, int w, int h) {
   return 0;
 }
 
-int write_ppm(FILE* f, uint8_t* data, int w, int h, bool headless, bool binary) {
-  if (headless == false) {
-    if (binary) {
-      fprintf(f, "P6\n");
+int write_ppm_data_ascii(FILE* f, const uint8_t* data,
+                         const PPMLayout& layout, int threads) {
+  static const bool tables_ready = init_ascii_tables();
+  (void)tables_ready;
+
+  // Each band is formatted into its own buffer of about kChunkBytes.
+  size_t row_bytes = (size_t)layout.width * layout.channels *
+                     kMaxAsciiSampleBytes;
+  int band_rows = kChunkBytes / row_bytes;
+  if (band_rows < 1) {
+    band_rows = 1;
+  }
+
+  if (threads < 1) {
+    threads = 1;
+  }
+
+  std::vector<std::vector<char> > bufs(threads);
+  std::vector<size_t> sizes(threads);
+  for (int t = 0; t < threads; ++t) {
+    bufs[t].resize(band_rows * row_bytes + 4);
+  }
+
+  auto format_band = [&bufs, &sizes, data, &layout](int t, int begin,
+                                                    int end) {
+    if (layout.depth == 16) {
+      sizes[t] = format_rows_ascii<uint16_t>(bufs[t].data(), data, layout,
+                                             begin, end);
     } else {
-      fprintf(f, "P3\n");
+      sizes[t] = format_rows_ascii<uint8_t>(bufs[t].data(), data, layout,
+                                            begin, end);
     }
+  };
+
+  // Format up to `threads` bands in parallel, then write them in order.
+  const int h = layout.height;
+  for (int row = 0; row < h; row += band_rows * threads) {
+    std::vector<std::thread> workers;
+    int bands = 0;
+    for (int t = 0; t < threads; ++t) {
+      int begin = row + t * band_rows;
+      if (begin >= h) {
+        break;
+      }
+
+      int end = begin + band_rows < h ? begin + band_rows : h;
+      ++bands;
+      if (threads == 1) {
+        format_band(t, begin, end);
+      } else {
+        workers.push_back(std::thread(format_band, t, begin, end));
+      }
+    }
+
+    for (auto& worker : workers) {
+      worker.join();
+    }
+
+    for (int t = 0; t < bands; ++t) {
+      if (write_buffer(f, bufs[t].data(), sizes[t]) != 0) {
+        return 1;
+      }
+    }
+  }
+
+  return 0;
+}
+
+// Byte permutation applied to every pixel while writing:
+// output byte i of a pixel comes from input byte order[i].
+typedef struct {
+  int pixel_bytes;
+  uint8_t order[8];
+  bool identity;   // nothing to do
+  bool swap_only;  // only the bytes of 16-bit samples are swapped
+} Swizzle;
+
+static Swizzle make_swizzle(const PPMLayout& layout) {
+  Swizzle swz;
+  const int sample_bytes = layout.depth / 8;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  const bool swap = false;
+#else
+  const bool swap = sample_bytes == 2;  // Netpbm samples are big-endian
+#endif
+
+  swz.pixel_bytes = layout.channels * sample_bytes;
+  swz.identity = !swap;
+  swz.swap_only = swap;
+  for (int k = 0; k < layout.channels; ++k) {
+    int src = source_channel(layout, k);
+    if (src != k) {
+      swz.identity = false;
+      swz.swap_only = false;
+    }
+
+    for (int b = 0; b < sample_bytes; ++b) {
+      int src_byte = swap ? sample_bytes - 1 - b : b;
+      swz.order[k * sample_bytes + b] = src * sample_bytes + src_byte;
+    }
+  }
+
+  return swz;
+}
+
+// Copy n 16-bit samples from src to dst, swapping the bytes of each.
+static void swap_bytes_16(uint8_t* dst, const uint8_t* src, size_t n) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  for (; i + 8 <= n; i += 8) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * i));
+    v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2 * i), v);
+  }
+#elif defined(__ARM_NEON)
+  for (; i + 8 <= n; i += 8) {
+    vst1q_u8(dst + 2 * i, vrev16q_u8(vld1q_u8(src + 2 * i)));
+  }
+#endif
+  for (; i < n; ++i) {
+    dst[2 * i] = src[2 * i + 1];
+    dst[2 * i + 1] = src[2 * i];
+  }
+}
+
+#if defined(HAVE_BYTE_SHUFFLE)
+// Copy src to dst in blocks of 16 bytes, each permuted by mask, advancing
+// by step bytes; the bytes of a block past step are scratch and get
+// overwritten by the next one. Returns the number of bytes done.
+#if defined(BYTE_SHUFFLE_AT_RUNTIME)
+__attribute__((target("ssse3")))
+#endif
+static size_t shuffle_bytes(uint8_t* dst, const uint8_t* src, size_t size,
+                            const uint8_t* mask_bytes, size_t step) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  const __m128i mask =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(mask_bytes));
+  for (; i + 16 <= size; i += step) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                     _mm_shuffle_epi8(v, mask));
+  }
+#else
+  const uint8x16_t mask = vld1q_u8(mask_bytes);
+  for (; i + 16 <= size; i += step) {
+    vst1q_u8(dst + i, vqtbl1q_u8(vld1q_u8(src + i), mask));
+  }
+#endif
+  return i;
+}
+
+static bool have_byte_shuffle() {
+#if defined(BYTE_SHUFFLE_AT_RUNTIME)
+  static const bool supported = __builtin_cpu_supports("ssse3");
+  return supported;
+#else
+  return true;
+#endif
+}
+#endif
+
+// Copy n pixels from src to dst, permuting the bytes of each.
+static void apply_swizzle(uint8_t* dst, const uint8_t* src, size_t n,
+                          const Swizzle& swz) {
+  const size_t pb = swz.pixel_bytes;
+  if (swz.swap_only) {
+    swap_bytes_16(dst, src, n * pb / 2);
+    return;
+  }
+
+  size_t i = 0;  // in bytes, always at a pixel boundary
+#if defined(HAVE_BYTE_SHUFFLE)
+  if (have_byte_shuffle()) {
+    // Permute as many whole pixels as fit in 16 bytes with one shuffle.
+    const size_t step = 16 / pb * pb;
+    uint8_t mask_bytes[16];
+    for (size_t j = 0; j < 16; ++j) {
+      mask_bytes[j] = j < step ? j / pb * pb + swz.order[j % pb] : j;
+    }
+
+    i = shuffle_bytes(dst, src, n * pb, mask_bytes, step);
+  }
+#endif
+  for (; i < n * pb; i += pb) {
+    for (size_t b = 0; b < pb; ++b) {
+      dst[i + b] = src[i + swz.order[b]];
+    }
+  }
+}
+
+int write_ppm_data_binary(FILE* f, const uint8_t* data,
+                          const PPMLayout& layout) {
+  const Swizzle swz = make_swizzle(layout);
+  const size_t stride = row_stride(layout);
+  const size_t row_bytes = (size_t)layout.width * swz.pixel_bytes;
+
+  if (swz.identity) {
+    if (stride == row_bytes) {
+      return write_buffer(f, data, row_bytes * layout.height);
+    }
+
+    for (int i = 0; i < layout.height; ++i) {
+      if (write_buffer(f, data + i * stride, row_bytes) != 0) {
+        return 1;
+      }
+    }
+
+    return 0;
+  }
+
+  // Reorder through a small buffer, splitting rows that do not fit.
+  std::vector<uint8_t> buf(kSwizzleChunkBytes);
+  const size_t capacity = kSwizzleChunkBytes / swz.pixel_bytes;
+  size_t filled = 0;  // in pixels
+  for (int i = 0; i < layout.height; ++i) {
+    const uint8_t* src = data + i * stride;
+    size_t left = layout.width;
+    while (left > 0) {
+      if (filled == capacity) {
+        if (write_buffer(f, buf.data(), filled * swz.pixel_bytes) != 0) {
+          return 1;
+        }
+
+        filled = 0;
+      }
+
+      size_t n = left < capacity - filled ? left : capacity - filled;
+      apply_swizzle(buf.data() + filled * swz.pixel_bytes, src, n, swz);
+      src += n * swz.pixel_bytes;
+      filled += n;
+      left -= n;
+    }
+  }
+
+  return write_buffer(f, buf.data(), filled * swz.pixel_bytes);
+}
+
+static void write_header(FILE* f, const PPMLayout& layout, bool binary) {
+  int maxval = layout.depth == 16 ? 65535 : 255;
+  if (layout.channels == 1 || layout.channels == 3) {
+    if (layout.channels == 1) {
+      fprintf(f, binary ? "P5\n" : "P2\n");
+    } else {
+      fprintf(f, binary ? "P6\n" : "P3\n");
+    }
+
+    fprintf(f, "%d %d\n", layout.width, layout.height);
+    fprintf(f, "%d\n", maxval);  // max color
+  } else {
+    fprintf(f, "P7\n");
+    fprintf(f, "WIDTH %d\n", layout.width);
+    fprintf(f, "HEIGHT %d\n", layout.height);
+    fprintf(f, "DEPTH %d\n", layout.channels);
+    fprintf(f, "MAXVAL %d\n", maxval);
+    fprintf(f, "TUPLTYPE %s\n",
+            layout.channels == 2 ? "GRAYSCALE_ALPHA" : "RGB_ALPHA");
+    fprintf(f, "ENDHDR\n");
+  }
+}
+
+int write_ppm(FILE* f, const uint8_t* data, const PPMLayout& layout,
+              bool headless, bool binary, int threads) {
+  if (layout.channels < 1 || layout.channels > 4) {
+    fprintf(stderr, "Error: unsupported number of channels: %d\n",
+            layout.channels);
+    return 1;
+  }
+
+  if (layout.depth != 8 && layout.depth != 16) {
+    fprintf(stderr, "Error: unsupported bit depth: %d\n", layout.depth);
+    return 1;
+  }
+
+  if (!binary && (layout.channels == 2 || layout.channels == 4)) {
+    fprintf(stderr, "Error: images with alpha can only be written as "
+            "binary PAM\n");
+    return 1;
+  }
+
+  if (headless == false) {
+    write_header(f, layout, binary);
+  }
 
-    fprintf(f, "%d %d\n", w, h);
-    fprintf(f, "%d\n", 255);  // max color
+  if (layout.width <= 0 || layout.height <= 0) {
+    return 0;
   }
 
   if (binary) {
-    return write_ppm_data_binary(f, data, w, h);
+    return write_ppm_data_binary(f, data, layout);
   } else {
-    return write_ppm_data_ascii(f, data, w, h);
+    return write_ppm_data_ascii(f, data, layout, threads);
   }
 }
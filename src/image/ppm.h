@@ -1,6 +1,27 @@
 #ifndef _PPM_H_
 #define _PPM_H_
 
-int write_ppm(FILE* f, uint8_t* data, int w, int h, bool headless, bool binary);
+#include <stdint.h>
+#include <stdio.h>
+
+// Layout of the samples handed to write_ppm.
+typedef struct {
+  int width;
+  int height;
+  int channels;   // 1 (gray), 2 (gray + alpha), 3 (RGB) or 4 (RGB + alpha)
+  int depth;      // bits per sample: 8 or 16, in host byte order
+  size_t stride;  // bytes per row; 0 means rows are tightly packed
+  bool bgr;       // color samples are in B, G, R(, A) order, as in cv::Mat
+} PPMLayout;
+
+// Write an image as PGM (1 channel), PPM (3 channels) or PAM (2 or 4
+// channels; binary only). 16-bit images get maxval 65535 and are stored
+// big-endian, as Netpbm requires. BGR input is reordered to RGB and
+// byte-swapped on the fly in small chunks, so no converted copy of the
+// whole image is made.
+// In ASCII mode, threads > 1 formats row bands in parallel;
+// the output is identical to the single-threaded one.
+int write_ppm(FILE* f, const uint8_t* data, const PPMLayout& layout,
+              bool headless, bool binary, int threads = 1);
 
 #endif  // _PPM_H_
@@ -0,0 +1,94 @@
+// Copyright: This program is released into the public domain.
+
+// Convert a PPM/PGM/PAM file to any format supported by cv::imwrite.
+// Refer to:
+// https://en.wikipedia.org/wiki/Netpbm_format
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <opencv2/opencv.hpp>
+#include "ppm_reader.h"
+
+static const char* program = "ppm2img";
+static const char* version = "0.1.0";
+static const char* usage =
+    "Usage: %s [options] input_file output_file\n"
+    "\n"
+    "Options:\n"
+    "  -h, --help                   Print this help message and exit\n"
+    "  -v, --version                Print version message and exit\n"
+    "  -I, --info                   Print the file header and exit\n"
+    "\n";
+
+static bool info_only = false;
+
+int main(int argc, char** argv) {
+  int show_help = 0;
+  int show_version = 0;
+
+  static struct option long_options[] = {
+      {"help", no_argument, &show_help, 'h'},
+      {"version", no_argument, &show_version, 'v'},
+      {"info", no_argument, 0, 'I'},
+      {0, 0, 0, 0}};
+
+  while (true) {
+    int opt = getopt_long(argc, argv, "hvI", long_options, nullptr);
+    if (opt == -1) {
+      break;
+    } else if (opt == 'h') {
+      printf(usage, program);
+      exit(EXIT_SUCCESS);
+    } else if (opt == 'v') {
+      printf("%s version %s\n", program, version);
+      exit(EXIT_SUCCESS);
+    } else if (opt == 'I') {
+      info_only = true;
+    } else {  // 'h'
+      fprintf(stderr, usage, program);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (argc - optind != (info_only ? 1 : 2)) {
+    fprintf(stderr, usage, program);
+    exit(EXIT_FAILURE);
+  }
+
+  const char* input_file = argv[optind++];
+
+  PPMInfo info;
+  cv::Mat image = read_ppm(input_file, &info);
+  if (image.empty()) {
+    exit(2);
+  }
+
+  if (info_only) {
+    printf("Format: P%c\n", info.format);
+    printf("Width: %d\n", info.width);
+    printf("Height: %d\n", info.height);
+    printf("Depth: %d\n", info.channels);
+    printf("Maxval: %d\n", info.maxval);
+    printf("Tuple type: %s\n", info.tuple_type.c_str());
+    return 0;
+  }
+
+  const char* output_file = argv[optind++];
+
+  // cv::imwrite expects BGR(A); gray images are written straight
+  // from the file mapping.
+  cv::Mat out_image = image;
+  if (image.channels() == 3) {
+    cv::cvtColor(image, out_image, cv::COLOR_RGB2BGR);
+  } else if (image.channels() == 4) {
+    cv::cvtColor(image, out_image, cv::COLOR_RGBA2BGRA);
+  }
+
+  if (!cv::imwrite(output_file, out_image)) {
+    fprintf(stderr, "Error: cannot write to %s\n", output_file);
+    exit(3);
+  }
+
+  return 0;
+}
@@ -0,0 +1,306 @@
+// Netpbm reader returning cv::Mat views of memory-mapped files.
+// Refer to:
+// http://netpbm.sourceforge.net/doc/ppm.html
+// http://netpbm.sourceforge.net/doc/pam.html
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string>
+#include <opencv2/core/core.hpp>
+#include "ppm_reader.h"
+
+// Releases the file mapping when the last Mat referring to it goes away.
+// cv::Mat::release() hands UMatData to unmap(), whose default
+// implementation calls deallocate() once both refcounts reach zero.
+class MappedFileAllocator : public cv::MatAllocator {
+ public:
+  cv::UMatData* allocate(int dims, const int* sizes, int type, void* data,
+                         size_t* step, int flags,
+                         cv::UMatUsageFlags usageFlags) const override {
+    return nullptr;  // mappings are only created by read_ppm()
+  }
+
+  bool allocate(cv::UMatData* u, int accessflags,
+                cv::UMatUsageFlags usageFlags) const override {
+    return false;
+  }
+
+  void deallocate(cv::UMatData* u) const override {
+    if (u == nullptr) {
+      return;
+    }
+
+    munmap(u->origdata, u->size);
+    delete u;
+  }
+};
+
+static MappedFileAllocator mapped_file_allocator;
+
+typedef struct {
+  const uint8_t* p;
+  const uint8_t* end;
+} Cursor;
+
+static bool is_space(uint8_t c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' ||
+         c == '\f';
+}
+
+// Skip whitespace and '#' comments.
+static void skip_space(Cursor* c) {
+  while (c->p < c->end) {
+    if (is_space(*c->p)) {
+      ++c->p;
+    } else if (*c->p == '#') {
+      while (c->p < c->end && *c->p != '\n') {
+        ++c->p;
+      }
+    } else {
+      break;
+    }
+  }
+}
+
+static bool read_uint(Cursor* c, int* value) {
+  skip_space(c);
+  if (c->p >= c->end || *c->p < '0' || *c->p > '9') {
+    return false;
+  }
+
+  long v = 0;
+  while (c->p < c->end && *c->p >= '0' && *c->p <= '9') {
+    v = v * 10 + (*c->p++ - '0');
+    if (v > INT32_MAX) {
+      return false;
+    }
+  }
+
+  *value = static_cast<int>(v);
+  return true;
+}
+
+static std::string read_token(Cursor* c) {
+  skip_space(c);
+  const uint8_t* begin = c->p;
+  while (c->p < c->end && !is_space(*c->p)) {
+    ++c->p;
+  }
+
+  return std::string(begin, c->p);
+}
+
+static bool parse_pnm_header(Cursor* c, PPMInfo* info) {
+  if (!read_uint(c, &info->width) || !read_uint(c, &info->height) ||
+      !read_uint(c, &info->maxval)) {
+    return false;
+  }
+
+  // exactly one whitespace character separates maxval from the raster
+  if (c->p >= c->end || !is_space(*c->p)) {
+    return false;
+  }
+
+  ++c->p;
+  if (info->format == '2' || info->format == '5') {
+    info->channels = 1;
+    info->tuple_type = "GRAYSCALE";
+  } else {
+    info->channels = 3;
+    info->tuple_type = "RGB";
+  }
+
+  return true;
+}
+
+static bool parse_pam_header(Cursor* c, PPMInfo* info) {
+  info->width = info->height = info->channels = info->maxval = 0;
+  while (true) {
+    std::string key = read_token(c);
+    if (key.empty()) {
+      return false;
+    } else if (key == "ENDHDR") {
+      break;
+    } else if (key == "WIDTH") {
+      if (!read_uint(c, &info->width)) {
+        return false;
+      }
+    } else if (key == "HEIGHT") {
+      if (!read_uint(c, &info->height)) {
+        return false;
+      }
+    } else if (key == "DEPTH") {
+      if (!read_uint(c, &info->channels)) {
+        return false;
+      }
+    } else if (key == "MAXVAL") {
+      if (!read_uint(c, &info->maxval)) {
+        return false;
+      }
+    } else if (key == "TUPLTYPE") {
+      // the rest of the line, possibly spread over several TUPLTYPE lines
+      while (c->p < c->end && (*c->p == ' ' || *c->p == '\t')) {
+        ++c->p;
+      }
+
+      const uint8_t* begin = c->p;
+      while (c->p < c->end && *c->p != '\n') {
+        ++c->p;
+      }
+
+      if (!info->tuple_type.empty()) {
+        info->tuple_type += ' ';
+      }
+
+      info->tuple_type.append(begin, c->p);
+    } else {
+      fprintf(stderr, "Error: unknown PAM header field: %s\n", key.c_str());
+      return false;
+    }
+  }
+
+  // ENDHDR is followed by a single newline
+  if (c->p >= c->end || *c->p != '\n') {
+    return false;
+  }
+
+  ++c->p;
+  return info->width > 0 && info->height > 0 && info->channels > 0 &&
+         info->channels <= 4;
+}
+
+static void swap_bytes_16(cv::Mat* mat) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  for (int i = 0; i < mat->rows; ++i) {
+    uint8_t* p = mat->ptr<uint8_t>(i);
+    size_t n = mat->cols * mat->channels();
+    for (size_t j = 0; j < n; ++j) {
+      uint8_t hi = p[2 * j];
+      p[2 * j] = p[2 * j + 1];
+      p[2 * j + 1] = hi;
+    }
+  }
+#else
+  (void)mat;
+#endif
+}
+
+template <typename T>
+static bool read_ascii_raster(Cursor* c, const PPMInfo& info, cv::Mat* mat) {
+  for (int i = 0; i < mat->rows; ++i) {
+    T* row = mat->ptr<T>(i);
+    for (int j = 0, n = mat->cols * mat->channels(); j < n; ++j) {
+      int v;
+      if (!read_uint(c, &v) || v > info.maxval) {
+        return false;
+      }
+
+      row[j] = static_cast<T>(v);
+    }
+  }
+
+  return true;
+}
+
+cv::Mat read_ppm(const char* filename, PPMInfo* info) {
+  PPMInfo local_info;
+  if (info == nullptr) {
+    info = &local_info;
+  }
+
+  int fd = open(filename, O_RDONLY);
+  if (fd == -1) {
+    fprintf(stderr, "Error: cannot open %s: %s\n", filename, strerror(errno));
+    return cv::Mat();
+  }
+
+  struct stat sb;
+  if (fstat(fd, &sb) != 0 || sb.st_size < 3) {
+    fprintf(stderr, "Error: cannot read %s\n", filename);
+    close(fd);
+    return cv::Mat();
+  }
+
+  size_t map_size = sb.st_size;
+  void* map = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd,
+                   0);
+  close(fd);  // the mapping keeps the file referenced
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "Error: mmap failed for %s: %s\n", filename,
+            strerror(errno));
+    return cv::Mat();
+  }
+
+  const uint8_t* base = static_cast<const uint8_t*>(map);
+  Cursor c = {base + 2, base + map_size};
+  info->format = base[1];
+  info->tuple_type.clear();
+
+  bool ok = false;
+  if (base[0] != 'P') {
+    ok = false;
+  } else if (info->format == '2' || info->format == '3' ||
+             info->format == '5' || info->format == '6') {
+    ok = parse_pnm_header(&c, info);
+  } else if (info->format == '7') {
+    ok = parse_pam_header(&c, info);
+  }
+
+  if (!ok || info->width <= 0 || info->height <= 0 || info->maxval <= 0 ||
+      info->maxval > 65535) {
+    fprintf(stderr, "Error: not a supported Netpbm file: %s\n", filename);
+    munmap(map, map_size);
+    return cv::Mat();
+  }
+
+  int depth = info->maxval < 256 ? CV_8U : CV_16U;
+  int type = CV_MAKETYPE(depth, info->channels);
+
+  if (info->format == '2' || info->format == '3') {
+    cv::Mat mat(info->height, info->width, type);
+    if (depth == CV_8U) {
+      ok = read_ascii_raster<uint8_t>(&c, *info, &mat);
+    } else {
+      ok = read_ascii_raster<uint16_t>(&c, *info, &mat);
+    }
+
+    munmap(map, map_size);
+    if (!ok) {
+      fprintf(stderr, "Error: bad or truncated raster in %s\n", filename);
+      return cv::Mat();
+    }
+
+    return mat;
+  }
+
+  size_t sample_bytes = depth == CV_8U ? 1 : 2;
+  size_t row_bytes = sample_bytes * info->channels * info->width;
+  size_t payload = c.end - c.p;
+  if (payload / row_bytes < static_cast<size_t>(info->height)) {
+    fprintf(stderr, "Error: truncated raster in %s\n", filename);
+    munmap(map, map_size);
+    return cv::Mat();
+  }
+
+  // A header over the payload that owns the mapping through its UMatData.
+  cv::Mat mat(info->height, info->width, type, const_cast<uint8_t*>(c.p),
+              row_bytes);
+  cv::UMatData* u = new cv::UMatData(&mapped_file_allocator);
+  u->data = u->origdata = static_cast<uchar*>(map);
+  u->size = map_size;
+  u->refcount = 1;
+  mat.u = u;
+  mat.allocator = &mapped_file_allocator;
+
+  if (depth == CV_16U) {
+    swap_bytes_16(&mat);  // Netpbm stores 16-bit samples MSB first
+  }
+
+  return mat;
+}
@@ -0,0 +1,32 @@
+#ifndef _PPM_READER_H_
+#define _PPM_READER_H_
+
+#include <string>
+#include <opencv2/core/core.hpp>
+
+// Header fields of a Netpbm file.
+typedef struct {
+  char format;             // '2', '3', '5', '6' or '7'
+  int width;
+  int height;
+  int channels;            // PAM DEPTH; 1 for PGM, 3 for PPM
+  int maxval;
+  std::string tuple_type;  // PAM TUPLTYPE, or GRAYSCALE/RGB for PGM/PPM
+} PPMInfo;
+
+// Read a P2/P3 (ASCII), P5/P6 (binary) or P7 (PAM) file.
+//
+// Samples keep the file's channel order (RGB, RGB_ALPHA, ...), so color
+// images are not in OpenCV's BGR order. Depth is CV_8U for maxval < 256
+// and CV_16U otherwise.
+//
+// For binary formats the returned Mat points straight at the pixel payload
+// of a private mapping of the file, which is unmapped when the last Mat
+// referring to it is released. Writes go to copy-on-write pages and never
+// reach the file. 16-bit samples are swapped to host byte order in place,
+// which copies the pages they live on.
+//
+// Returns an empty Mat on failure, like cv::imread.
+cv::Mat read_ppm(const char* filename, PPMInfo* info = nullptr);
+
+#endif  // _PPM_READER_H_
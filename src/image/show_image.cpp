@@ -3,13 +3,50 @@
 // Refer to:
 // https://docs.opencv.org/3.1.0/d3/d63/classcv_1_1Mat.html
 
+// With --stats, print the per-channel statistics of images, or of all
+// images in directories, as one JSON object per image instead.
+
+#include <dirent.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <iostream>
+#include <mutex>
 #include <string>
 #include <map>
+#include <thread>
+#include <vector>
 
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgcodecs.hpp>
 #include <opencv2/highgui/highgui.hpp>
+#include "json_string.h"
+#include "mat_stats.h"
+
+static const char* program = "show_image";
+static const char* version = "0.2.0";
+static const char* usage =
+    "Usage: %s [options] image_file\n"
+    "       %s [options] -s file_or_dir...\n"
+    "\n"
+    "Options:\n"
+    "  -h, --help                   Print this help message and exit\n"
+    "  -v, --version                Print version message and exit\n"
+    "  -s, --stats                  Print the min, max, mean, standard\n"
+    "                               deviation and NaN/Inf count of each\n"
+    "                               channel as JSON instead of showing the\n"
+    "                               image; directories are read in full\n"
+    "  -H, --histogram              Add the %d-bin histogram of each\n"
+    "                               channel to the statistics\n"
+    "  -j, --jobs <Number>          Number of threads (default: number of\n"
+    "                               CPUs)\n"
+    "\n";
 
 #define ADD_TYPE(t) res[t] = #t;
 
@@ -78,6 +115,13 @@ std::map<int, std::string> GetMatTypeMap() {
 
 #undef ADD_TYPE
 
+// The map is built once, on first use, as is the depth map below.
+static const char* TypeName(int type) {
+  static const std::map<int, std::string> type_map = GetMatTypeMap();
+  auto it = type_map.find(type);
+  return it != type_map.end() ? it->second.c_str() : "unknown";
+}
+
 void PrintMatProps(const cv::Mat& image) {
   printf("data: %p\n", image.data);
 
@@ -99,7 +143,7 @@ void PrintMatProps(const cv::Mat& image) {
   //  (the type of each individual channel). For example, for a
   //  16-bit signed element array, the method returns CV_16S .
   const char* depth = "unknown";
-  auto depth_map = GetMatDepthMap();
+  static const std::map<int, std::string> depth_map = GetMatDepthMap();
   auto it1 = depth_map.find(image.depth());
   if (it1 != depth_map.end()) {
     depth = it1->second.c_str();
@@ -120,23 +164,220 @@ void PrintMatProps(const cv::Mat& image) {
   printf("total(): %d\n", (int)image.total());
 
   // Returns the type of a matrix element.
-  const char* type = "unknown";
-  auto type_map = GetMatTypeMap();
-  auto it2 = type_map.find(image.type());
-  if (it2 != type_map.end()) {
-    type = it2->second.c_str();
+  printf("type(): %s\n", TypeName(image.type()));
+}
+
+static bool IsImageFile(const char* name) {
+  static const char* extensions[] = {".jpg", ".jpeg", ".png", ".bmp",
+                                     ".ppm", ".pgm", ".pnm", ".tif",
+                                     ".tiff", ".webp", ".exr", ".hdr"};
+  const char* dot = strrchr(name, '.');
+  if (dot == nullptr) {
+    return false;
   }
 
-  printf("type(): %s\n", type);
+  for (const char* ext : extensions) {
+    if (strcasecmp(dot, ext) == 0) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// Add path, or the images in it, sorted, if it is a directory.
+static bool AddImages(const char* path, std::vector<std::string>* files) {
+  struct stat st;
+  if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+    files->push_back(path);
+    return true;
+  }
+
+  DIR* d = opendir(path);
+  if (d == nullptr) {
+    fprintf(stderr, "Error: cannot open directory %s\n", path);
+    return false;
+  }
+
+  std::vector<std::string> names;
+  while (struct dirent* entry = readdir(d)) {
+    if (IsImageFile(entry->d_name)) {
+      names.push_back(std::string(path) + "/" + entry->d_name);
+    }
+  }
+
+  closedir(d);
+  std::sort(names.begin(), names.end());
+  files->insert(files->end(), names.begin(), names.end());
+  return true;
+}
+
+// Sets *ok to whether the statistics could be computed; the JSON has an
+// "error" member otherwise.
+static std::string StatsToJson(const std::string& file, int threads,
+                               bool histogram, bool* ok) {
+  std::string json = "{\"file\": ";
+  append_json_string(&json, file);
+  *ok = false;
+
+  cv::Mat image = cv::imread(file, cv::IMREAD_UNCHANGED);
+  std::vector<ChannelStats> stats;
+  if (image.empty()) {
+    json += ", \"error\": \"cannot read\"}";
+    return json;
+  } else if (!compute_stats(image, &stats, threads)) {
+    json += ", \"error\": \"unsupported depth\"}";
+    return json;
+  }
+
+  *ok = true;
+
+  char buf[256];
+  snprintf(buf, sizeof(buf), ", \"width\": %d, \"height\": %d, "
+           "\"type\": \"%s\", \"channels\": [", image.cols, image.rows,
+           TypeName(image.type()));
+  json += buf;
+  for (size_t c = 0; c < stats.size(); ++c) {
+    const ChannelStats& s = stats[c];
+    snprintf(buf, sizeof(buf), "%s{\"min\": %.9g, \"max\": %.9g, "
+             "\"mean\": %.9g, \"stddev\": %.9g, \"nan\": %lld, "
+             "\"inf\": %lld", c > 0 ? ", " : "", s.min, s.max, s.mean,
+             s.stddev, static_cast<long long>(s.nan_count),
+             static_cast<long long>(s.inf_count));
+    json += buf;
+    if (histogram) {
+      json += ", \"histogram\": [";
+      for (int k = 0; k < kStatsBins; ++k) {
+        snprintf(buf, sizeof(buf), "%s%lld", k > 0 ? ", " : "",
+                 static_cast<long long>(s.histogram[k]));
+        json += buf;
+      }
+
+      json += "]";
+    }
+
+    json += "}";
+  }
+
+  json += "]}";
+  return json;
+}
+
+// Workers take files in order and leave the result in their slot; the
+// main thread prints each line as soon as the ones before it are done.
+// With a single file, its rows are split among the threads instead.
+static int PrintStats(const std::vector<std::string>& files, int jobs,
+                      bool histogram) {
+  const int threads_per_image = files.size() == 1 ? jobs : 1;
+  std::vector<std::string> results(files.size());
+  std::vector<bool> done(files.size(), false);
+  std::vector<bool> computed(files.size(), false);
+  std::mutex mutex;
+  std::condition_variable finished;
+  std::atomic<size_t> next(0);
+
+  auto worker = [&] {
+    while (true) {
+      size_t i = next++;
+      if (i >= files.size()) {
+        break;
+      }
+
+      bool ok;
+      std::string json = StatsToJson(files[i], threads_per_image, histogram,
+                                     &ok);
+      std::lock_guard<std::mutex> lock(mutex);
+      results[i].swap(json);
+      computed[i] = ok;
+      done[i] = true;
+      finished.notify_one();
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < jobs && i < static_cast<int>(files.size()); ++i) {
+    threads.push_back(std::thread(worker));
+  }
+
+  int failed = 0;
+  for (size_t i = 0; i < files.size(); ++i) {
+    std::string json;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      finished.wait(lock, [&] { return done[i]; });
+      json.swap(results[i]);
+      failed += !computed[i];
+    }
+
+    puts(json.c_str());
+  }
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  return failed == 0 ? 0 : 2;
 }
 
 int main(int argc, char** argv) {
-  if (argc < 2) {
-    std::cerr << "Usage: show_image filename\n";
-    return 1;
+  int show_help = 0;
+  int show_version = 0;
+  bool stats = false;
+  bool histogram = false;
+  int jobs = std::max(1u, std::thread::hardware_concurrency());
+
+  static struct option long_options[] = {
+      {"help", no_argument, &show_help, 'h'},
+      {"version", no_argument, &show_version, 'v'},
+      {"stats", no_argument, 0, 's'},
+      {"histogram", no_argument, 0, 'H'},
+      {"jobs", required_argument, 0, 'j'},
+      {0, 0, 0, 0}};
+
+  while (true) {
+    int opt = getopt_long(argc, argv, "hvsHj:", long_options, nullptr);
+    if (opt == -1) {
+      break;
+    } else if (opt == 'h') {
+      printf(usage, program, program, kStatsBins);
+      exit(EXIT_SUCCESS);
+    } else if (opt == 'v') {
+      printf("%s version %s\n", program, version);
+      exit(EXIT_SUCCESS);
+    } else if (opt == 's') {
+      stats = true;
+    } else if (opt == 'H') {
+      histogram = true;
+    } else if (opt == 'j') {
+      jobs = atoi(optarg);
+      if (jobs < 1) {
+        fprintf(stderr, "Error: invalid number of jobs: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+    } else {  // 'h'
+      fprintf(stderr, usage, program, program, kStatsBins);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  int count = argc - optind;
+  if (count < 1 || (!stats && count != 1)) {
+    fprintf(stderr, usage, program, program, kStatsBins);
+    exit(EXIT_FAILURE);
+  }
+
+  if (stats) {
+    std::vector<std::string> files;
+    for (int i = optind; i < argc; ++i) {
+      if (!AddImages(argv[i], &files)) {
+        exit(2);
+      }
+    }
+
+    return PrintStats(files, jobs, histogram);
   }
 
-  cv::Mat image = cv::imread(argv[1], cv::IMREAD_UNCHANGED);
+  cv::Mat image = cv::imread(argv[optind], cv::IMREAD_UNCHANGED);
   if (image.empty()) {  // see [1]
     std::cout <<  "Could not open or find the image" << std::endl;
     return -1;
@@ -1,13 +1,54 @@
 // Copyright: This program is released into the public domain.
 
+// Convert WebP images to JPEG: one file, or with -o a batch of files and
+// directories on a pool of threads. A batch keeps a cache in the output
+// directory that records the digest of each input and the quality of its
+// output, so a rerun skips the files that have not changed.
+
+#include <dirent.h>
+#include <getopt.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
 #include <stdexcept>
+#include <string>
+#include <thread>
 #include <vector>
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgcodecs.hpp>
+#include "content_hash.h"
+
+static const char* program = "webp2jpg";
+static const char* version = "0.2.0";
+static const char* usage =
+    "Usage: %s input_file output_file quality\n"
+    "       %s [options] -o output_dir input...\n"
+    "\n"
+    "Each input is a .webp file or a directory of them.\n"
+    "\n"
+    "Options:\n"
+    "  -h, --help                   Print this help message and exit\n"
+    "  -v, --version                Print version message and exit\n"
+    "  -o, --output <Dir>           Write name.jpg to Dir for each name.webp\n"
+    "  -q, --quality <Number>       JPEG quality (1-100, default: 90)\n"
+    "  -l, --list <File>            Also convert the files listed in File,\n"
+    "                               one per line; - reads stdin\n"
+    "  -j, --jobs <Number>          Number of threads (default: number of\n"
+    "                               CPUs)\n"
+    "  -f, --force                  Convert every file, even if the cache\n"
+    "                               says its output is up to date\n"
+    "\n";
+
+// Name of the cache file in the output directory.
+static const char* kCacheName = ".webp2jpg-cache";
 
 const char* find_ext_name(const char* str) {
     if (str == NULL) {
@@ -35,55 +76,399 @@ int compare_ext_name(const char* str, const char* ext_name) {
 const char* input_ext_name = ".webp";
 const char* output_ext_name = ".jpg";
 
-int main(int argc, char** argv) {
-  if (argc != 4) {
-    std::cerr << "Usage: webp2jpg input_file output_file quality\n";
-    exit(1);
+typedef std::chrono::steady_clock Clock;
+
+// What produced an output file, keyed by its name in the cache.
+typedef struct {
+  uint64_t digest;  // content_hash() of the input file
+  int quality;
+  long long size;   // of the output, to notice it was replaced
+} CacheEntry;
+
+typedef std::map<std::string, CacheEntry> Cache;
+
+static void load_cache(const std::string& path, Cache* cache) {
+  FILE* f = fopen(path.c_str(), "r");
+  if (f == nullptr) {
+    return;  // first run
+  }
+
+  char line[4096];
+  while (fgets(line, sizeof(line), f) != nullptr) {
+    unsigned long long digest;
+    CacheEntry entry;
+    int name_start = 0;
+    if (sscanf(line, "%llx %d %lld %n", &digest, &entry.quality,
+               &entry.size, &name_start) != 3 || name_start == 0) {
+      continue;
+    }
+
+    std::string name(line + name_start);
+    while (!name.empty() && (name.back() == '\n' || name.back() == '\r')) {
+      name.pop_back();
+    }
+
+    entry.digest = digest;
+    (*cache)[name] = entry;
+  }
+
+  fclose(f);
+}
+
+// Write to a temporary file first, so an interrupted run cannot leave a
+// truncated cache behind.
+static bool save_cache(const std::string& path, const Cache& cache) {
+  std::string tmp = path + ".tmp";
+  FILE* f = fopen(tmp.c_str(), "w");
+  if (f == nullptr) {
+    return false;
+  }
+
+  for (const auto& item : cache) {
+    fprintf(f, "%016llx %d %lld %s\n",
+            static_cast<unsigned long long>(item.second.digest),
+            item.second.quality, item.second.size, item.first.c_str());
+  }
+
+  bool ok = fclose(f) == 0;
+  return ok && rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+static long long file_size(const std::string& path) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0 ? st.st_size : -1;
+}
+
+static bool read_file(const std::string& path, std::vector<uchar>* data) {
+  FILE* f = fopen(path.c_str(), "rb");
+  if (f == nullptr) {
+    return false;
+  }
+
+  bool ok = fseek(f, 0, SEEK_END) == 0;
+  long size = ok ? ftell(f) : -1;
+  ok = size >= 0 && fseek(f, 0, SEEK_SET) == 0;
+  if (ok) {
+    data->resize(size);
+    ok = fread(data->data(), 1, size, f) == static_cast<size_t>(size);
+  }
+
+  fclose(f);
+  return ok;
+}
+
+// Add path, or the .webp files in it, sorted, if it is a directory.
+static bool add_inputs(const char* path, std::vector<std::string>* files) {
+  struct stat st;
+  if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+    files->push_back(path);
+    return true;
   }
 
-  const char* input_file = argv[1];
+  DIR* d = opendir(path);
+  if (d == nullptr) {
+    fprintf(stderr, "Error: cannot open directory %s\n", path);
+    return false;
+  }
+
+  std::vector<std::string> names;
+  while (struct dirent* entry = readdir(d)) {
+    if (compare_ext_name(entry->d_name, input_ext_name) == 0) {
+      names.push_back(std::string(path) + "/" + entry->d_name);
+    }
+  }
+
+  closedir(d);
+  std::sort(names.begin(), names.end());
+  files->insert(files->end(), names.begin(), names.end());
+  return true;
+}
+
+static bool read_list(const char* list_file, std::vector<std::string>* files) {
+  FILE* f = strcmp(list_file, "-") == 0 ? stdin : fopen(list_file, "r");
+  if (f == nullptr) {
+    fprintf(stderr, "Error: cannot open %s\n", list_file);
+    return false;
+  }
+
+  char line[4096];
+  while (fgets(line, sizeof(line), f) != nullptr) {
+    size_t n = strlen(line);
+    while (n > 0 && (line[n - 1] == '\n' || line[n - 1] == '\r')) {
+      line[--n] = '\0';
+    }
+
+    if (n > 0) {
+      files->push_back(line);
+    }
+  }
+
+  if (f != stdin) {
+    fclose(f);
+  }
+
+  return true;
+}
+
+static bool write_jpeg(const char* output_file, const cv::Mat& image,
+                       int quality) {
+  std::vector<int> compression_params;
+  compression_params.push_back(cv::IMWRITE_JPEG_QUALITY);
+  compression_params.push_back(quality);
+
+  try {
+    if (!cv::imwrite(output_file, image, compression_params)) {
+      fprintf(stderr, "Cannot save image: %s\n", output_file);
+      return false;
+    }
+  } catch (std::exception& ex) {
+    fprintf(stderr, "Cannot save image: %s\n", ex.what());
+    return false;
+  }
+
+  return true;
+}
+
+// The name of the JPEG file for a WebP input in a batch: its own file name
+// with the extension replaced. It is also the key of the input in the cache.
+static std::string output_name(const std::string& input) {
+  size_t slash = input.rfind('/');
+  std::string name = input.substr(slash == std::string::npos ? 0
+                                                             : slash + 1);
+  name.replace(name.size() - strlen(input_ext_name), strlen(input_ext_name),
+               output_ext_name);
+  return name;
+}
+
+static int convert_batch(const std::vector<std::string>& files,
+                         const char* output_dir, int quality, int jobs,
+                         bool force) {
+  // Inputs with the same name in different directories would be written
+  // to the same output, by two workers at once.
+  std::set<std::string> names;
+  for (const std::string& input : files) {
+    if (compare_ext_name(input.c_str(), input_ext_name) == 0 &&
+        !names.insert(output_name(input)).second) {
+      fprintf(stderr, "Error: more than one input is converted to %s/%s: "
+              "%s\n", output_dir, output_name(input).c_str(), input.c_str());
+      return 2;
+    }
+  }
+
+  const std::string cache_path = std::string(output_dir) + "/" + kCacheName;
+  Cache cache;
+  load_cache(cache_path, &cache);
+
+  std::mutex cache_mutex;
+  std::atomic<size_t> next(0);
+  std::atomic<int> converted(0);
+  std::atomic<int> skipped(0);
+  std::atomic<int> failed(0);
+  std::atomic<long long> bytes_read(0);
+
+  auto worker = [&] {
+    std::vector<uchar> data;
+    while (true) {
+      size_t i = next++;
+      if (i >= files.size()) {
+        break;
+      }
+
+      const std::string& input = files[i];
+      if (compare_ext_name(input.c_str(), input_ext_name) != 0) {
+        fprintf(stderr, "Error: input file extension must be %s: %s\n",
+                input_ext_name, input.c_str());
+        ++failed;
+        continue;
+      }
+
+      if (!read_file(input, &data)) {
+        fprintf(stderr, "Error: cannot read %s\n", input.c_str());
+        ++failed;
+        continue;
+      }
+
+      bytes_read += data.size();
+      const uint64_t digest = content_hash(data.data(), data.size());
+
+      const std::string name = output_name(input);
+      const std::string output = std::string(output_dir) + "/" + name;
+
+      // up to date: same input and quality, and the output is still the
+      // file we wrote
+      bool cached = false;
+      {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        auto it = cache.find(name);
+        cached = !force && it != cache.end() &&
+                 it->second.digest == digest &&
+                 it->second.quality == quality;
+        if (cached) {
+          cached = file_size(output) == it->second.size;
+        }
+      }
+
+      if (cached) {
+        ++skipped;
+        continue;
+      }
+
+      // decode from the bytes already read for the digest
+      cv::Mat image = cv::imdecode(data, cv::IMREAD_COLOR);
+      if (image.empty()) {
+        fprintf(stderr, "Error: cannot decode %s\n", input.c_str());
+        ++failed;
+        continue;
+      }
+
+      if (!write_jpeg(output.c_str(), image, quality)) {
+        ++failed;
+        continue;
+      }
+
+      CacheEntry entry = {digest, quality, file_size(output)};
+      {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        cache[name] = entry;
+      }
+
+      ++converted;
+    }
+  };
+
+  Clock::time_point start = Clock::now();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < jobs && i < static_cast<int>(files.size()); ++i) {
+    threads.push_back(std::thread(worker));
+  }
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  double elapsed =
+      std::chrono::duration<double>(Clock::now() - start).count();
+  if (!save_cache(cache_path, cache)) {
+    fprintf(stderr, "Warning: cannot write %s\n", cache_path.c_str());
+  }
+
+  fprintf(stderr, "Converted %d, skipped %d, failed %d of %zu files in "
+          "%.2f s (%.1f files/s, %.1f MB/s read)\n", converted.load(),
+          skipped.load(), failed.load(), files.size(), elapsed,
+          files.size() / elapsed, bytes_read / elapsed / 1e6);
+  return failed > 0 ? 2 : 0;
+}
+
+static int convert_one(const char* input_file, const char* output_file,
+                       int quality) {
   if (compare_ext_name(input_file, input_ext_name) != 0) {
     std::cerr << "Error: input file extension must be "
               << input_ext_name << std::endl;
     exit(1);
   }
 
-  const char* output_file = argv[2];
   if (compare_ext_name(output_file, ".jpg") != 0) {
     std::cerr << "Error: output file extension must be "
               << output_ext_name << std::endl;
     exit(1);
   }
 
-  int quality = atoi(argv[3]);
-  if (quality <= 0) {
-    std::cerr << "Error: quality must be between [1, 100]\n";
-    exit(1);
-  }
-
   cv::Mat image = cv::imread(input_file, cv::IMREAD_COLOR);
   if (image.empty()) {
     std::cout <<  "Could not open or find the image" << std::endl;
     exit(2);
   }
 
-  std::vector<int> compression_params;
-  compression_params.push_back(cv::IMWRITE_JPEG_QUALITY);
-  compression_params.push_back(quality);
-
-  try {
-    fprintf(stderr, "Saving image file ...\n");
-    int ok = cv::imwrite(output_file, image, compression_params);
-    if (ok) {
-      printf("Image saved to [%s]\n", output_file);
-    } else {
-      fprintf(stderr, "Cannot save image: %s\n", output_file);
-      exit(3);
-    }
-  } catch (std::runtime_error& ex) {
-    fprintf(stderr, "Cannot save image: %s\n", ex.what());
+  fprintf(stderr, "Saving image file ...\n");
+  if (!write_jpeg(output_file, image, quality)) {
     exit(3);
   }
 
+  printf("Image saved to [%s]\n", output_file);
   return 0;
 }
+
+static int parse_quality(const char* str) {
+  int quality = atoi(str);
+  if (quality <= 0 || quality > 100) {
+    std::cerr << "Error: quality must be between [1, 100]\n";
+    exit(1);
+  }
+
+  return quality;
+}
+
+int main(int argc, char** argv) {
+  int show_help = 0;
+  int show_version = 0;
+  const char* output_dir = nullptr;
+  int quality = 90;
+  int jobs = std::max(1u, std::thread::hardware_concurrency());
+  bool force = false;
+  std::vector<std::string> files;
+
+  static struct option long_options[] = {
+      {"help", no_argument, &show_help, 'h'},
+      {"version", no_argument, &show_version, 'v'},
+      {"output", required_argument, 0, 'o'},
+      {"quality", required_argument, 0, 'q'},
+      {"list", required_argument, 0, 'l'},
+      {"jobs", required_argument, 0, 'j'},
+      {"force", no_argument, 0, 'f'},
+      {0, 0, 0, 0}};
+
+  while (true) {
+    int opt = getopt_long(argc, argv, "hvo:q:l:j:f", long_options, nullptr);
+    if (opt == -1) {
+      break;
+    } else if (opt == 'h') {
+      printf(usage, program, program);
+      exit(EXIT_SUCCESS);
+    } else if (opt == 'v') {
+      printf("%s version %s\n", program, version);
+      exit(EXIT_SUCCESS);
+    } else if (opt == 'o') {
+      output_dir = optarg;
+    } else if (opt == 'q') {
+      quality = parse_quality(optarg);
+    } else if (opt == 'l') {
+      if (!read_list(optarg, &files)) {
+        exit(2);
+      }
+    } else if (opt == 'j') {
+      jobs = atoi(optarg);
+      if (jobs < 1) {
+        fprintf(stderr, "Error: invalid number of jobs: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+    } else if (opt == 'f') {
+      force = true;
+    } else {  // 'h'
+      fprintf(stderr, usage, program, program);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (output_dir == nullptr) {
+    if (argc - optind != 3 || !files.empty()) {
+      fprintf(stderr, usage, program, program);
+      exit(1);
+    }
+
+    return convert_one(argv[optind], argv[optind + 1],
+                       parse_quality(argv[optind + 2]));
+  }
+
+  for (int i = optind; i < argc; ++i) {
+    if (!add_inputs(argv[i], &files)) {
+      exit(2);
+    }
+  }
+
+  if (files.empty()) {
+    fprintf(stderr, usage, program, program);
+    exit(1);
+  }
+
+  return convert_batch(files, output_dir, quality, jobs, force);
+}
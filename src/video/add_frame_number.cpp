@@ -0,0 +1,200 @@
+// Copyright: This program is released into the public domain.
+
+// Print the frame number on each frame of a video, like
+// python/video/add_frame_number.py, with decoding, drawing and encoding
+// on separate threads.
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <opencv2/opencv.hpp>
+#include "frame_queue.h"
+#include "glyph_cache.h"
+
+static const char* program = "add_frame_number";
+static const char* version = "0.1.0";
+static const char* usage =
+"Usage: %s [options] input_file output_file\n"
+"\n"
+"Options:\n"
+"  -h, --help                   Print this help message and exit\n"
+"  -v, --version                Print version message and exit\n"
+"  -w, --watch                  Play the video while converting\n"
+"\n";
+
+// Frames in flight between two stages.
+static const size_t kQueueFrames = 4;
+
+typedef std::chrono::steady_clock Clock;
+
+typedef struct {
+  cv::Mat image;
+  long index;
+} Frame;
+
+// Format seconds as H:MM:SS.mmm, e.g. 100.5 => 0:01:40.500
+std::string format_time(double decimal_seconds) {
+  long seconds = static_cast<long>(decimal_seconds);
+  int milliseconds = static_cast<int>((decimal_seconds - seconds) * 1000);
+  char text[32];
+  snprintf(text, sizeof(text), "%ld:%02ld:%02ld.%03d", seconds / 3600,
+           seconds % 3600 / 60, seconds % 60, milliseconds);
+  return text;
+}
+
+static void decode_frames(cv::VideoCapture* cap,
+                          BoundedQueue<cv::Mat>* free_images,
+                          BoundedQueue<Frame>* decoded) {
+  for (long index = 0;; ++index) {
+    Frame frame;
+    if (!free_images->pop(&frame.image)) {
+      break;
+    }
+
+    if (!cap->read(frame.image)) {  // reuses the recycled buffer
+      break;
+    }
+
+    frame.index = index;
+    if (!decoded->push(std::move(frame))) {
+      break;
+    }
+  }
+
+  decoded->close();
+}
+
+static void draw_frame_numbers(const GlyphCache* glyphs,
+                               BoundedQueue<Frame>* decoded,
+                               BoundedQueue<Frame>* drawn) {
+  Frame frame;
+  while (decoded->pop(&frame)) {
+    char text[32];
+    snprintf(text, sizeof(text), "% 8ld", frame.index);
+    glyphs->draw(&frame.image, text, cv::Point(frame.image.cols - 180, 50));
+    if (!drawn->push(std::move(frame))) {
+      break;
+    }
+  }
+
+  drawn->close();
+}
+
+int main(int argc, char** argv) {
+  int show_help = 0;
+  int show_version = 0;
+  bool watch = false;
+
+  static struct option long_options[] = {
+    {"help", no_argument, &show_help, 'h'},
+    {"version", no_argument, &show_version, 'v'},
+    {"watch", no_argument, 0, 'w'},
+    {0, 0, 0, 0}
+  };
+
+  while (true) {
+    int opt = getopt_long(argc, argv, "hvw", long_options, nullptr);
+    if (opt == -1) {
+      break;
+    } else if (opt == 'h') {
+      printf(usage, program);
+      exit(EXIT_SUCCESS);
+    } else if (opt == 'v') {
+      printf("%s version %s\n", program, version);
+      exit(EXIT_SUCCESS);
+    } else if (opt == 'w') {
+      watch = true;
+    } else {  // 'h'
+      fprintf(stderr, usage, program);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (argc - optind != 2) {
+    fprintf(stderr, usage, program);
+    exit(EXIT_FAILURE);
+  }
+
+  const char* input_file = argv[optind];
+  const char* output_file = argv[optind + 1];
+
+  cv::VideoCapture cap(input_file);
+  if (!cap.isOpened()) {
+    fprintf(stderr, "Error: cannot open input file\n");
+    exit(1);
+  }
+
+  int width = static_cast<int>(cap.get(cv::CAP_PROP_FRAME_WIDTH));
+  int height = static_cast<int>(cap.get(cv::CAP_PROP_FRAME_HEIGHT));
+  long frames = static_cast<long>(cap.get(cv::CAP_PROP_FRAME_COUNT));
+  cv::VideoWriter wrt(output_file,
+                      static_cast<int>(cap.get(cv::CAP_PROP_FOURCC)),
+                      cap.get(cv::CAP_PROP_FPS), cv::Size(width, height));
+  if (!wrt.isOpened()) {
+    fprintf(stderr, "Error: cannot open output file\n");
+    exit(3);
+  }
+
+  // same look as putText(img, text, (width - 180, 50),
+  // FONT_HERSHEY_SIMPLEX, 1, (0, 0, 255), 2, LINE_AA) in the script
+  const GlyphCache glyphs("0123456789-", cv::FONT_HERSHEY_SIMPLEX, 1.0, 2,
+                          cv::Scalar(0, 0, 255));
+
+  // every Mat is either in a queue, in a stage, or free
+  BoundedQueue<cv::Mat> free_images(3 * kQueueFrames + 3);
+  BoundedQueue<Frame> decoded(kQueueFrames);
+  BoundedQueue<Frame> drawn(kQueueFrames);
+  for (size_t i = 0; i < 3 * kQueueFrames + 3; ++i) {
+    free_images.push(cv::Mat());
+  }
+
+  std::thread decoder(decode_frames, &cap, &free_images, &decoded);
+  std::thread drawer(draw_frame_numbers, &glyphs, &decoded, &drawn);
+
+  Clock::time_point start_time = Clock::now();
+  Clock::time_point last_report;
+  Frame frame;
+  long index = 0;
+  while (drawn.pop(&frame)) {
+    wrt.write(frame.image);
+
+    if (watch) {
+      cv::imshow("video", frame.image);
+      int key = cv::waitKey(1) & 0xff;
+      if (key == 'q') {  // quit
+        break;
+      }
+    }
+
+    free_images.push(std::move(frame.image));
+
+    ++index;
+    Clock::time_point curr_time = Clock::now();
+    if (curr_time - last_report >= std::chrono::milliseconds(100) ||
+        index == frames) {
+      double elapsed =
+          std::chrono::duration<double>(curr_time - start_time).count();
+      double remain = frames > index ? elapsed * (frames - index) / index : 0;
+      double percent = frames > 0 ? 100.0 * index / frames : 0;
+      printf("%ld/%ld %.2f%% %s\r", index, frames, percent,
+             format_time(remain).c_str());
+      fflush(stdout);
+      last_report = curr_time;
+    }
+  }
+
+  // unblock the other stages if we quit early
+  free_images.close();
+  decoded.close();
+  drawn.close();
+  decoder.join();
+  drawer.join();
+
+  printf("\n");
+  cap.release();
+  wrt.release();
+  return 0;
+}
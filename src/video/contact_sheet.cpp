@@ -0,0 +1,251 @@
+// Copyright: This program is released into the public domain.
+
+// Make a grid of evenly spaced thumbnails of a video. Several captures
+// of the same file seek to disjoint parts of it in parallel, and each
+// frame is scaled straight into its tile of the output image.
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "glyph_cache.h"
+
+static const char* program = "contact_sheet";
+static const char* version = "0.1.0";
+static const char* usage =
+"Usage: %s [options] video_file image_file\n"
+"\n"
+"Options:\n"
+"  -h, --help                   Print this help message and exit\n"
+"  -v, --version                Print version message and exit\n"
+"  -n, --count <Number>         Number of thumbnails (default: 16)\n"
+"  -c, --columns <Number>       Thumbnails per row (default: square grid)\n"
+"  -w, --width <Number>         Thumbnail width in pixels (default: 320)\n"
+"  -j, --jobs <Number>          Number of parallel captures (default: 4)\n"
+"  -Q, --quality <Number>       JPEG quality (0-100, default: 90)\n"
+"  -t, --timestamps             Print the time of each frame on its tile\n"
+"\n";
+
+// Read forward instead of seeking when the next thumbnail is this close.
+static const long kGrabFrames = 16;
+
+typedef struct {
+  int count;
+  int columns;
+  int tile_width;
+  int tile_height;  // from the aspect ratio of the video
+  int jobs;
+  int quality;
+  bool timestamps;
+} Config;
+
+static int parse_int(const char* str, int min, int max, const char* what) {
+  char* end = nullptr;
+  long v = strtol(str, &end, 10);
+  if (end == str || *end != '\0' || v < min || v > max) {
+    fprintf(stderr, "Error: invalid %s: %s\n", what, str);
+    exit(EXIT_FAILURE);
+  }
+
+  return static_cast<int>(v);
+}
+
+// Fill tiles [begin, end) of the sheet from one capture of the video.
+static void fill_tiles(const char* video_file, const Config& config,
+                       const std::vector<long>& frames, int begin, int end,
+                       const GlyphCache* glyphs, cv::Mat* sheet,
+                       std::atomic<int>* failed) {
+  cv::VideoCapture cap(video_file);
+  if (!cap.isOpened()) {
+    fprintf(stderr, "Error: failed to open video file: %s\n", video_file);
+    *failed += end - begin;
+    return;
+  }
+
+  const int tile_height = config.tile_height;
+  long cur = 0;  // number of the next frame the capture returns
+  cv::Mat frame;
+  for (int i = begin; i < end; ++i) {
+    long target = frames[i];
+    if (target < cur || target - cur > kGrabFrames) {
+      cap.set(cv::CAP_PROP_POS_FRAMES, target);
+      cur = static_cast<long>(cap.get(cv::CAP_PROP_POS_FRAMES));
+    }
+
+    bool ok = true;
+    while (cur < target && (ok = cap.grab())) {
+      ++cur;
+    }
+
+    if (!ok || !cap.read(frame)) {
+      fprintf(stderr, "Error: cannot read frame %ld\n", target);
+      ++*failed;
+      continue;
+    }
+
+    ++cur;
+
+    // resize() writes into the tile in place, as it already has the
+    // right size and type
+    cv::Rect rect((i % config.columns) * config.tile_width,
+                  (i / config.columns) * tile_height, config.tile_width,
+                  tile_height);
+    cv::Mat tile = (*sheet)(rect);
+    cv::resize(frame, tile, tile.size(), 0, 0, cv::INTER_AREA);
+
+    if (glyphs != nullptr) {
+      long ms = static_cast<long>(cap.get(cv::CAP_PROP_POS_MSEC));
+      char text[32];
+      snprintf(text, sizeof(text), "%ld:%02ld:%02ld", ms / 3600000,
+               ms / 60000 % 60, ms / 1000 % 60);
+      glyphs->draw(&tile, text, cv::Point(4, tile_height - 6));
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  int show_help = 0;
+  int show_version = 0;
+  Config config = {16, 0, 320, 0, 4, 90, false};
+
+  static struct option long_options[] = {
+    {"help", no_argument, &show_help, 'h'},
+    {"version", no_argument, &show_version, 'v'},
+    {"count", required_argument, 0, 'n'},
+    {"columns", required_argument, 0, 'c'},
+    {"width", required_argument, 0, 'w'},
+    {"jobs", required_argument, 0, 'j'},
+    {"quality", required_argument, 0, 'Q'},
+    {"timestamps", no_argument, 0, 't'},
+    {0, 0, 0, 0}
+  };
+
+  while (true) {
+    int opt = getopt_long(argc, argv, "hvn:c:w:j:Q:t", long_options, nullptr);
+    if (opt == -1) {
+      break;
+    } else if (opt == 'h') {
+      printf(usage, program);
+      exit(EXIT_SUCCESS);
+    } else if (opt == 'v') {
+      printf("%s version %s\n", program, version);
+      exit(EXIT_SUCCESS);
+    } else if (opt == 'n') {
+      config.count = parse_int(optarg, 1, 10000, "count");
+    } else if (opt == 'c') {
+      config.columns = parse_int(optarg, 1, 10000, "number of columns");
+    } else if (opt == 'w') {
+      config.tile_width = parse_int(optarg, 8, 8192, "width");
+    } else if (opt == 'j') {
+      config.jobs = parse_int(optarg, 1, 256, "number of jobs");
+    } else if (opt == 'Q') {
+      config.quality = parse_int(optarg, 0, 100, "quality");
+    } else if (opt == 't') {
+      config.timestamps = true;
+    } else {  // 'h'
+      fprintf(stderr, usage, program);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (argc - optind != 2) {
+    fprintf(stderr, usage, program);
+    exit(EXIT_FAILURE);
+  }
+
+  const char* video_file = argv[optind];
+  const char* image_file = argv[optind + 1];
+
+  long frame_count;
+  int width;
+  int height;
+  {
+    cv::VideoCapture cap(video_file);
+    if (!cap.isOpened()) {
+      fprintf(stderr, "Error: failed to open video file: %s\n", video_file);
+      exit(2);
+    }
+
+    frame_count = static_cast<long>(cap.get(cv::CAP_PROP_FRAME_COUNT));
+    width = static_cast<int>(cap.get(cv::CAP_PROP_FRAME_WIDTH));
+    height = static_cast<int>(cap.get(cv::CAP_PROP_FRAME_HEIGHT));
+  }
+
+  if (frame_count <= 0 || width <= 0 || height <= 0) {
+    fprintf(stderr, "Error: unknown frame count or size: %s\n", video_file);
+    exit(2);
+  }
+
+  if (config.count > frame_count) {
+    config.count = static_cast<int>(frame_count);
+  }
+
+  if (config.columns == 0) {
+    config.columns = static_cast<int>(ceil(sqrt(config.count)));
+  }
+
+  if (config.columns > config.count) {
+    config.columns = config.count;
+  }
+
+  if (config.jobs > config.count) {
+    config.jobs = config.count;
+  }
+
+  // the middle frame of each of count equal parts of the video
+  std::vector<long> frames(config.count);
+  for (int i = 0; i < config.count; ++i) {
+    frames[i] = static_cast<long>((i + 0.5) * frame_count / config.count);
+  }
+
+  const int rows = (config.count + config.columns - 1) / config.columns;
+  config.tile_height = std::max(1, config.tile_width * height / width);
+  cv::Mat sheet = cv::Mat::zeros(rows * config.tile_height,
+                                 config.columns * config.tile_width, CV_8UC3);
+
+  std::unique_ptr<GlyphCache> glyphs;
+  if (config.timestamps) {
+    glyphs.reset(new GlyphCache("0123456789:", cv::FONT_HERSHEY_SIMPLEX,
+                                config.tile_height / 240.0, 1,
+                                cv::Scalar(255, 255, 255)));
+  }
+
+  // each capture takes a contiguous run of tiles and only seeks forward
+  std::atomic<int> failed(0);
+  std::vector<std::thread> threads;
+  for (int k = 0; k < config.jobs; ++k) {
+    int begin = config.count * k / config.jobs;
+    int end = config.count * (k + 1) / config.jobs;
+    threads.push_back(std::thread(fill_tiles, video_file, std::cref(config),
+                                  std::cref(frames), begin, end,
+                                  glyphs.get(),
+                                  &sheet, &failed));
+  }
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  const std::vector<int> imwrite_params = {cv::IMWRITE_JPEG_QUALITY,
+                                           config.quality};
+  if (!cv::imwrite(image_file, sheet, imwrite_params)) {
+    fprintf(stderr, "Error: failed to write %s\n", image_file);
+    exit(3);
+  }
+
+  if (failed > 0) {
+    fprintf(stderr, "Error: %d of %d thumbnails are missing\n", failed.load(),
+            config.count);
+    exit(2);
+  }
+
+  return 0;
+}
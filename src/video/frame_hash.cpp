@@ -0,0 +1,74 @@
+// Perceptual frame hashing.
+// Refer to:
+// http://www.hackerfactor.com/blog/index.php?/archives/529-Kind-of-Like-That.html
+
+#include <stdint.h>
+#include <opencv2/core/core.hpp>
+#include "frame_hash.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static const int kHashCols = 9;
+static const int kHashRows = 8;
+
+// Sum of n bytes.
+static uint64_t sum_bytes(const uint8_t* p, size_t n) {
+  uint64_t sum = 0;
+  size_t i = 0;
+#if defined(__SSE2__)
+  // _mm_sad_epu8 against zero adds up 8 bytes into each 64-bit half
+  const __m128i zero = _mm_setzero_si128();
+  __m128i acc = zero;
+  for (; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+    acc = _mm_add_epi64(acc, _mm_sad_epu8(v, zero));
+  }
+
+  // stored rather than moved to a register, which 32-bit x86 cannot do
+  uint64_t halves[2];
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(halves), acc);
+  sum = halves[0] + halves[1];
+#endif
+  for (; i < n; ++i) {
+    sum += p[i];
+  }
+
+  return sum;
+}
+
+uint64_t frame_dhash(const cv::Mat& image, int row_step) {
+  CV_Assert(image.depth() == CV_8U);
+
+  const int cn = image.channels();
+  int x[kHashCols + 1];  // block column bounds, in bytes
+  for (int c = 0; c <= kHashCols; ++c) {
+    x[c] = image.cols * c / kHashCols * cn;
+  }
+
+  uint64_t blocks[kHashRows][kHashCols] = {};
+  for (int r = 0; r < kHashRows; ++r) {
+    const int y0 = image.rows * r / kHashRows;
+    const int y1 = image.rows * (r + 1) / kHashRows;
+    for (int y = y0; y < y1; y += row_step) {
+      const uint8_t* row = image.ptr<uint8_t>(y);
+      for (int c = 0; c < kHashCols; ++c) {
+        blocks[r][c] += sum_bytes(row + x[c], x[c + 1] - x[c]);
+      }
+    }
+  }
+
+  // Blocks in a row hold the same number of rows but may differ in
+  // width by one pixel; compare averages to stay exact.
+  uint64_t hash = 0;
+  for (int r = 0; r < kHashRows; ++r) {
+    for (int c = 0; c + 1 < kHashCols; ++c) {
+      uint64_t left = blocks[r][c] * (x[c + 2] - x[c + 1]);
+      uint64_t right = blocks[r][c + 1] * (x[c + 1] - x[c]);
+      hash = (hash << 1) | (left > right ? 1 : 0);
+    }
+  }
+
+  return hash;
+}
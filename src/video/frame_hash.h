@@ -0,0 +1,18 @@
+#ifndef _FRAME_HASH_H_
+#define _FRAME_HASH_H_
+
+#include <stdint.h>
+#include <opencv2/core/core.hpp>
+
+// 64-bit difference hash (dHash) of an 8-bit image with 1 to 4 channels.
+// The image is reduced to 9x8 block sums over all channels; each bit
+// tells whether a block is brighter than its right neighbour. Only every
+// row_step-th row is read, which is plenty for a perceptual hash.
+uint64_t frame_dhash(const cv::Mat& image, int row_step = 2);
+
+// Number of differing bits between two hashes.
+static inline int hash_distance(uint64_t a, uint64_t b) {
+  return __builtin_popcountll(a ^ b);
+}
+
+#endif  // _FRAME_HASH_H_
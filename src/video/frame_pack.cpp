@@ -0,0 +1,194 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include "frame_pack.h"
+
+static const char kPackMagic[8] = {'C', 'V', 'F', 'P', 'A', 'C', 'K', '1'};
+static const char kIndexMagic[8] = {'C', 'V', 'F', 'P', 'I', 'D', 'X', '1'};
+
+// index_offset, count and the index magic
+static const size_t kFooterBytes = 24;
+
+// Appends go through a large stdio buffer instead of one small write
+// per frame.
+static const size_t kWriteBufferBytes = 4 << 20;
+
+static_assert(sizeof(PackEntry) == 32, "PackEntry must not be padded");
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#error "frame packs are read and written in host byte order"
+#endif
+
+FramePackWriter::FramePackWriter()
+    : file_(nullptr), offset_(0), failed_(false) {}
+
+FramePackWriter::~FramePackWriter() {
+  if (file_ != nullptr) {
+    close();
+  }
+}
+
+bool FramePackWriter::open(const char* path) {
+  file_ = fopen(path, "wb");
+  if (file_ == nullptr) {
+    fprintf(stderr, "Error: cannot open %s: %s\n", path, strerror(errno));
+    return false;
+  }
+
+  setvbuf(file_, nullptr, _IOFBF, kWriteBufferBytes);
+  entries_.clear();
+  failed_ = fwrite(kPackMagic, 1, sizeof(kPackMagic), file_) !=
+            sizeof(kPackMagic);
+  offset_ = sizeof(kPackMagic);
+  return !failed_;
+}
+
+bool FramePackWriter::append(uint64_t frame, double time_ms,
+                             const uint8_t* data, size_t length) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (file_ == nullptr || failed_) {
+    return false;
+  }
+
+  if (fwrite(data, 1, length, file_) != length) {
+    fprintf(stderr, "Error: pack write failed: %s\n", strerror(errno));
+    failed_ = true;
+    return false;
+  }
+
+  PackEntry entry = {frame, time_ms, offset_, length};
+  entries_.push_back(entry);
+  offset_ += length;
+  return true;
+}
+
+bool FramePackWriter::close() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (file_ == nullptr) {
+    return false;
+  }
+
+  std::sort(entries_.begin(), entries_.end(),
+            [](const PackEntry& a, const PackEntry& b) {
+              return a.frame < b.frame;
+            });
+
+  // the index is read in place, so align it for its 64-bit fields
+  static const uint8_t zeros[8] = {0};
+  size_t padding = (8 - offset_ % 8) % 8;
+  uint64_t footer[2] = {offset_ + padding, entries_.size()};
+  if (!failed_) {
+    size_t n = entries_.size();
+    failed_ = fwrite(zeros, 1, padding, file_) != padding ||
+              fwrite(entries_.data(), sizeof(PackEntry), n, file_) != n ||
+              fwrite(footer, sizeof(footer), 1, file_) != 1 ||
+              fwrite(kIndexMagic, sizeof(kIndexMagic), 1, file_) != 1;
+  }
+
+  if (fclose(file_) != 0) {
+    failed_ = true;
+  }
+
+  file_ = nullptr;
+  if (failed_) {
+    fprintf(stderr, "Error: cannot write pack index: %s\n", strerror(errno));
+  }
+
+  return !failed_;
+}
+
+FramePackReader::FramePackReader()
+    : base_(nullptr), map_size_(0), entries_(nullptr), count_(0) {}
+
+FramePackReader::~FramePackReader() {
+  close();
+}
+
+bool FramePackReader::open(const char* path) {
+  close();
+
+  int fd = ::open(path, O_RDONLY);
+  if (fd == -1) {
+    fprintf(stderr, "Error: cannot open %s: %s\n", path, strerror(errno));
+    return false;
+  }
+
+  struct stat sb;
+  if (fstat(fd, &sb) != 0 ||
+      (size_t)sb.st_size < sizeof(kPackMagic) + kFooterBytes) {
+    fprintf(stderr, "Error: not a frame pack: %s\n", path);
+    ::close(fd);
+    return false;
+  }
+
+  void* map = mmap(nullptr, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "Error: mmap failed for %s: %s\n", path, strerror(errno));
+    return false;
+  }
+
+  base_ = static_cast<const uint8_t*>(map);
+  map_size_ = sb.st_size;
+
+  const uint8_t* footer = base_ + map_size_ - kFooterBytes;
+  uint64_t index_offset;
+  uint64_t count;
+  memcpy(&index_offset, footer, 8);
+  memcpy(&count, footer + 8, 8);
+  // compared without sums or products of file values, which could wrap
+  const uint64_t index_end = map_size_ - kFooterBytes;
+  if (memcmp(base_, kPackMagic, sizeof(kPackMagic)) != 0 ||
+      memcmp(footer + 16, kIndexMagic, sizeof(kIndexMagic)) != 0 ||
+      index_offset < sizeof(kPackMagic) || index_offset % 8 != 0 ||
+      index_offset > index_end ||
+      (index_end - index_offset) % sizeof(PackEntry) != 0 ||
+      count != (index_end - index_offset) / sizeof(PackEntry)) {
+    fprintf(stderr, "Error: not a frame pack or truncated: %s\n", path);
+    close();
+    return false;
+  }
+
+  entries_ = reinterpret_cast<const PackEntry*>(base_ + index_offset);
+  count_ = count;
+  by_frame_.reserve(count_);
+  for (size_t i = 0; i < count_; ++i) {
+    if (entries_[i].offset > index_offset ||
+        entries_[i].length > index_offset - entries_[i].offset) {
+      fprintf(stderr, "Error: corrupt pack index: %s\n", path);
+      close();
+      return false;
+    }
+
+    by_frame_[entries_[i].frame] = i;
+  }
+
+  return true;
+}
+
+void FramePackReader::close() {
+  if (base_ != nullptr) {
+    munmap(const_cast<uint8_t*>(base_), map_size_);
+  }
+
+  base_ = nullptr;
+  map_size_ = 0;
+  entries_ = nullptr;
+  count_ = 0;
+  by_frame_.clear();
+}
+
+const PackEntry* FramePackReader::find(uint64_t frame) const {
+  auto it = by_frame_.find(frame);
+  if (it == by_frame_.end()) {
+    return nullptr;
+  }
+
+  return &entries_[it->second];
+}
@@ -0,0 +1,84 @@
+#ifndef _FRAME_PACK_H_
+#define _FRAME_PACK_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// A frame pack holds many encoded images in one file:
+//
+//   "CVFPACK1"                      8-byte magic
+//   image data                      encoded frames, back to back
+//   padding                         to an 8-byte boundary
+//   index                           count x PackEntry
+//   index_offset, count             two uint64
+//   "CVFPIDX1"                      8-byte magic
+//
+// Integers are little-endian. The index is sorted by frame number and
+// sits at the end, so frames can be appended without knowing how many
+// there will be.
+
+typedef struct {
+  uint64_t frame;    // frame number in the source video
+  double time_ms;    // presentation time in the source video
+  uint64_t offset;   // from the start of the file
+  uint64_t length;   // in bytes
+} PackEntry;
+
+// Appends frames to a pack file. append() may be called from several
+// threads; the index order does not depend on the append order.
+class FramePackWriter {
+ public:
+  FramePackWriter();
+  ~FramePackWriter();
+
+  bool open(const char* path);
+  bool append(uint64_t frame, double time_ms, const uint8_t* data,
+              size_t length);
+  // Write the index. Returns false if any write has failed.
+  bool close();
+
+  size_t size() const { return entries_.size(); }
+
+ private:
+  FramePackWriter(const FramePackWriter&);
+  FramePackWriter& operator=(const FramePackWriter&);
+
+  FILE* file_;
+  uint64_t offset_;
+  bool failed_;
+  std::vector<PackEntry> entries_;
+  std::mutex mutex_;
+};
+
+// Maps a pack file and looks frames up in constant time.
+class FramePackReader {
+ public:
+  FramePackReader();
+  ~FramePackReader();
+
+  bool open(const char* path);
+  void close();
+
+  size_t size() const { return count_; }
+  const PackEntry& entry(size_t i) const { return entries_[i]; }
+  // Returns nullptr if the pack does not hold this frame.
+  const PackEntry* find(uint64_t frame) const;
+  const uint8_t* data(const PackEntry& entry) const {
+    return base_ + entry.offset;
+  }
+
+ private:
+  FramePackReader(const FramePackReader&);
+  FramePackReader& operator=(const FramePackReader&);
+
+  const uint8_t* base_;
+  size_t map_size_;
+  const PackEntry* entries_;
+  size_t count_;
+  std::unordered_map<uint64_t, size_t> by_frame_;
+};
+
+#endif  // _FRAME_PACK_H_
@@ -0,0 +1,182 @@
+#ifndef _FRAME_QUEUE_H_
+#define _FRAME_QUEUE_H_
+
+#include <stddef.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// A FIFO with a fixed capacity shared by producer and consumer threads.
+// push() blocks while the queue is full and pop() while it is empty.
+// close() wakes everybody up: pushes fail from then on, and pops drain
+// what is left before failing.
+// Every wakeup is signalled under the lock, so a consumer that has popped
+// the last item it is waiting for may destroy the queue right away.
+template <typename T>
+class BoundedQueue {
+ public:
+  explicit BoundedQueue(size_t capacity)
+      : capacity_(capacity), closed_(false), high_water_(0) {}
+
+  // Returns false if the queue has been closed.
+  bool push(T&& item) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_full_.wait(lock, [this] {
+      return closed_ || items_.size() < capacity_;
+    });
+    if (closed_) {
+      return false;
+    }
+
+    enqueue(std::move(item));
+    not_empty_.notify_one();
+    return true;
+  }
+
+  // Returns false, leaving item untouched, if the queue is full or closed.
+  bool try_push(T&& item) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (closed_ || items_.size() >= capacity_) {
+      return false;
+    }
+
+    enqueue(std::move(item));
+    not_empty_.notify_one();
+    return true;
+  }
+
+  // Returns false once the queue is closed and empty.
+  bool pop(T* item) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_empty_.wait(lock, [this] { return closed_ || !items_.empty(); });
+    if (items_.empty()) {
+      return false;
+    }
+
+    dequeue(item);
+    not_full_.notify_one();
+    return true;
+  }
+
+  // Returns false if the queue is empty.
+  bool try_pop(T* item) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (items_.empty()) {
+      return false;
+    }
+
+    dequeue(item);
+    not_full_.notify_one();
+    return true;
+  }
+
+  void close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    not_full_.notify_all();
+    not_empty_.notify_all();
+  }
+
+  size_t size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return items_.size();
+  }
+
+  // The largest number of items the queue has held at once.
+  size_t high_water() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return high_water_;
+  }
+
+ private:
+  void enqueue(T&& item) {
+    items_.push_back(std::move(item));
+    if (items_.size() > high_water_) {
+      high_water_ = items_.size();
+    }
+  }
+
+  void dequeue(T* item) {
+    *item = std::move(items_.front());
+    items_.pop_front();
+  }
+
+  const size_t capacity_;
+  bool closed_;
+  size_t high_water_;
+  std::deque<T> items_;
+  mutable std::mutex mutex_;
+  std::condition_variable not_full_;
+  std::condition_variable not_empty_;
+};
+
+// Puts items produced out of order, by several threads, back in order.
+// Items are numbered from 0; put() blocks while its index is a window
+// or more ahead of the next item take() returns, which bounds how many
+// items are held at once.
+template <typename T>
+class ReorderBuffer {
+ public:
+  explicit ReorderBuffer(size_t window)
+      : slots_(window), filled_(window, false), next_(0), closed_(false) {}
+
+  // Returns false if the buffer has been closed.
+  bool put(size_t index, T&& item) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_full_.wait(lock, [this, index] {
+      return closed_ || index < next_ + slots_.size();
+    });
+    if (closed_) {
+      return false;
+    }
+
+    size_t slot = index % slots_.size();
+    slots_[slot] = std::move(item);
+    filled_[slot] = true;
+    bool ready = index == next_;  // next_ only changes under the lock
+    lock.unlock();
+    if (ready) {
+      ready_.notify_one();
+    }
+
+    return true;
+  }
+
+  // Take the next item in order. Returns false if the buffer has been
+  // closed before that item arrived.
+  bool take(T* item) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    size_t slot = next_ % slots_.size();
+    ready_.wait(lock, [this, slot] { return closed_ || filled_[slot]; });
+    if (!filled_[slot]) {
+      return false;
+    }
+
+    *item = std::move(slots_[slot]);
+    filled_[slot] = false;
+    ++next_;
+    lock.unlock();
+    not_full_.notify_all();
+    return true;
+  }
+
+  void close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    not_full_.notify_all();
+    ready_.notify_all();
+  }
+
+ private:
+  std::vector<T> slots_;
+  std::vector<bool> filled_;
+  size_t next_;  // index of the item take() returns next
+  bool closed_;
+  std::mutex mutex_;
+  std::condition_variable not_full_;
+  std::condition_variable ready_;
+};
+
+#endif  // _FRAME_QUEUE_H_
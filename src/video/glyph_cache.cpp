@@ -0,0 +1,137 @@
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <opencv2/opencv.hpp>
+#include "glyph_cache.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// dst = (dst * (255 - a) + color * a) / 255, rounded, for n bytes.
+// inv_alpha holds 255 - a and color holds color * a; the sum stays below
+// 65536, so it fits in 16-bit lanes, and the division by 255 is
+// (x + 128 + ((x + 128) >> 8)) >> 8, exact over that range.
+static void blend_row(uint8_t* dst, const uint8_t* inv_alpha,
+                      const uint16_t* color, int n) {
+  int i = 0;
+#if defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i half = _mm_set1_epi16(128);
+  for (; i + 16 <= n; i += 16) {
+    __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+    __m128i ia =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(inv_alpha + i));
+    __m128i c_lo =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(color + i));
+    __m128i c_hi =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(color + i + 8));
+    __m128i lo = _mm_mullo_epi16(_mm_unpacklo_epi8(d, zero),
+                                 _mm_unpacklo_epi8(ia, zero));
+    __m128i hi = _mm_mullo_epi16(_mm_unpackhi_epi8(d, zero),
+                                 _mm_unpackhi_epi8(ia, zero));
+    lo = _mm_add_epi16(_mm_add_epi16(lo, c_lo), half);
+    hi = _mm_add_epi16(_mm_add_epi16(hi, c_hi), half);
+    lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+    hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                     _mm_packus_epi16(lo, hi));
+  }
+#elif defined(__ARM_NEON)
+  const uint16x8_t half = vdupq_n_u16(128);
+  for (; i + 8 <= n; i += 8) {
+    uint16x8_t x = vmull_u8(vld1_u8(dst + i), vld1_u8(inv_alpha + i));
+    x = vaddq_u16(vaddq_u16(x, vld1q_u16(color + i)), half);
+    x = vaddq_u16(x, vshrq_n_u16(x, 8));
+    vst1_u8(dst + i, vshrn_n_u16(x, 8));
+  }
+#endif
+  for (; i < n; ++i) {
+    unsigned x = dst[i] * inv_alpha[i] + color[i] + 128;
+    dst[i] = static_cast<uint8_t>((x + (x >> 8)) >> 8);
+  }
+}
+
+GlyphCache::GlyphCache(const std::string& chars, int font_face,
+                       double font_scale, int thickness,
+                       const cv::Scalar& color) {
+  int descent = 0;
+  ascent_ = cv::getTextSize(chars, font_face, font_scale, thickness,
+                            &descent).height;
+  pad_ = thickness + 2;  // room for anti-aliasing around the strokes
+  for (int i = 0; i < 128; ++i) {
+    glyphs_[i].advance = 0;
+  }
+
+  // the advance is what a second copy of the character adds to the width
+  int base;
+  space_ = cv::getTextSize("  ", font_face, font_scale, thickness, &base)
+               .width -
+           cv::getTextSize(" ", font_face, font_scale, thickness, &base).width;
+
+  for (char c : chars) {
+    if (c <= 0) {
+      continue;
+    }
+
+    std::string s(1, c);
+    cv::Size size = cv::getTextSize(s, font_face, font_scale, thickness,
+                                    &base);
+    Glyph& glyph = glyphs_[static_cast<int>(c)];
+    glyph.advance =
+        cv::getTextSize(s + s, font_face, font_scale, thickness, &base)
+            .width - size.width;
+
+    cv::Mat coverage = cv::Mat::zeros(ascent_ + descent + 2 * pad_,
+                                      size.width + 2 * pad_, CV_8UC1);
+    cv::putText(coverage, s, cv::Point(pad_, pad_ + ascent_), font_face,
+                font_scale, cv::Scalar(255), thickness, cv::LINE_AA);
+
+    glyph.inv_alpha.create(coverage.size(), CV_8UC3);
+    glyph.color.create(coverage.size(), CV_16UC3);
+    for (int y = 0; y < coverage.rows; ++y) {
+      const uint8_t* a = coverage.ptr<uint8_t>(y);
+      uint8_t* ia = glyph.inv_alpha.ptr<uint8_t>(y);
+      uint16_t* ca = glyph.color.ptr<uint16_t>(y);
+      for (int x = 0; x < coverage.cols; ++x) {
+        for (int k = 0; k < 3; ++k) {
+          ia[3 * x + k] = 255 - a[x];
+          ca[3 * x + k] = static_cast<uint16_t>(
+              cv::saturate_cast<uint8_t>(color[k]) * a[x]);
+        }
+      }
+    }
+  }
+}
+
+void GlyphCache::draw(cv::Mat* image, const char* text,
+                      cv::Point origin) const {
+  CV_Assert(image->type() == CV_8UC3);
+
+  int pen = origin.x;
+  for (const char* p = text; *p != '\0'; ++p) {
+    int c = static_cast<unsigned char>(*p);
+    const Glyph* glyph = c < 128 ? &glyphs_[c] : nullptr;
+    if (glyph == nullptr || glyph->inv_alpha.empty()) {
+      pen += glyph != nullptr && glyph->advance > 0 ? glyph->advance : space_;
+      continue;
+    }
+
+    // clip the glyph box to the image
+    cv::Rect box(pen - pad_, origin.y - ascent_ - pad_, glyph->inv_alpha.cols,
+                 glyph->inv_alpha.rows);
+    cv::Rect visible = box & cv::Rect(0, 0, image->cols, image->rows);
+    for (int y = visible.y; y < visible.y + visible.height; ++y) {
+      int gy = y - box.y;
+      int gx = visible.x - box.x;
+      blend_row(image->ptr<uint8_t>(y) + 3 * visible.x,
+                glyph->inv_alpha.ptr<uint8_t>(gy) + 3 * gx,
+                glyph->color.ptr<uint16_t>(gy) + 3 * gx, 3 * visible.width);
+    }
+
+    pen += glyph->advance;
+  }
+}
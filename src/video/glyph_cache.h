@@ -0,0 +1,35 @@
+#ifndef _GLYPH_CACHE_H_
+#define _GLYPH_CACHE_H_
+
+#include <string>
+#include <opencv2/core/core.hpp>
+
+// Draws short text on BGR frames from glyphs rendered once, up front,
+// with cv::putText. Each glyph keeps its anti-aliased coverage as alpha
+// and its color premultiplied by it, so drawing a character is one
+// SIMD blend of a small rectangle instead of rasterizing Hershey
+// strokes. The text looks the same as putText with the same settings.
+class GlyphCache {
+ public:
+  GlyphCache(const std::string& chars, int font_face, double font_scale,
+             int thickness, const cv::Scalar& color);
+
+  // Draw text with its baseline starting at origin, like cv::putText.
+  // Characters not in the cache are skipped, but still advance.
+  // The image must be CV_8UC3; glyphs are clipped to it.
+  void draw(cv::Mat* image, const char* text, cv::Point origin) const;
+
+ private:
+  typedef struct {
+    cv::Mat inv_alpha;  // CV_8UC3, 255 - coverage, for each channel
+    cv::Mat color;      // CV_16UC3, color * coverage
+    int advance;        // pen movement to the next character
+  } Glyph;
+
+  Glyph glyphs_[128];
+  int pad_;      // blank margin around each glyph
+  int ascent_;   // from the baseline to the top of the glyph box
+  int space_;    // advance of characters that are not cached
+};
+
+#endif  // _GLYPH_CACHE_H_
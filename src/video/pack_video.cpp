@@ -0,0 +1,239 @@
+// Copyright: This program is released into the public domain.
+
+// Turn a directory of frames, such as the output of unpack_video, back
+// into a video. Images are decoded in parallel and handed to a single
+// VideoWriter in file name order.
+
+#include <dirent.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "frame_queue.h"
+
+static const char* program = "pack_video";
+static const char* version = "0.1.0";
+static const char* usage =
+"Usage: %s [options] image_dir video_file\n"
+"\n"
+"Encodes the images of image_dir, sorted by file name, as the frames\n"
+"of video_file.\n"
+"\n"
+"Options:\n"
+"  -h, --help                   Print this help message and exit\n"
+"  -v, --version                Print version message and exit\n"
+"  -f, --fps <Number>           Frame rate (default: 30)\n"
+"  -c, --fourcc <Code>          Output codec (default: mp4v)\n"
+"  -j, --jobs <Number>          Number of decoder threads (default: 1)\n"
+"\n";
+
+typedef std::chrono::steady_clock Clock;
+
+static double seconds_since(Clock::time_point t) {
+  return std::chrono::duration<double>(Clock::now() - t).count();
+}
+
+static bool is_image_file(const char* name) {
+  static const char* extensions[] = {".jpg", ".jpeg", ".png", ".bmp",
+                                     ".ppm", ".pgm", ".tif", ".tiff",
+                                     ".webp"};
+  const char* dot = strrchr(name, '.');
+  if (dot == nullptr) {
+    return false;
+  }
+
+  for (const char* ext : extensions) {
+    if (strcasecmp(dot, ext) == 0) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static bool list_images(const char* dir, std::vector<std::string>* files) {
+  DIR* d = opendir(dir);
+  if (d == nullptr) {
+    fprintf(stderr, "Error: cannot open directory %s\n", dir);
+    return false;
+  }
+
+  while (struct dirent* entry = readdir(d)) {
+    if (is_image_file(entry->d_name)) {
+      files->push_back(std::string(dir) + "/" + entry->d_name);
+    }
+  }
+
+  closedir(d);
+  std::sort(files->begin(), files->end());
+  return true;
+}
+
+int main(int argc, char** argv) {
+  int show_help = 0;
+  int show_version = 0;
+  double fps = 30;
+  const char* fourcc = "mp4v";
+  int jobs = 1;
+
+  static struct option long_options[] = {
+    {"help", no_argument, &show_help, 'h'},
+    {"version", no_argument, &show_version, 'v'},
+    {"fps", required_argument, 0, 'f'},
+    {"fourcc", required_argument, 0, 'c'},
+    {"jobs", required_argument, 0, 'j'},
+    {0, 0, 0, 0}
+  };
+
+  while (true) {
+    int opt = getopt_long(argc, argv, "hvf:c:j:", long_options, nullptr);
+    if (opt == -1) {
+      break;
+    } else if (opt == 'h') {
+      printf(usage, program);
+      exit(EXIT_SUCCESS);
+    } else if (opt == 'v') {
+      printf("%s version %s\n", program, version);
+      exit(EXIT_SUCCESS);
+    } else if (opt == 'f') {
+      fps = atof(optarg);
+      if (fps <= 0) {
+        fprintf(stderr, "Error: invalid frame rate: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+    } else if (opt == 'c') {
+      if (strlen(optarg) != 4) {
+        fprintf(stderr, "Error: a FourCC has 4 characters: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+
+      fourcc = optarg;
+    } else if (opt == 'j') {
+      jobs = atoi(optarg);
+      if (jobs < 1) {
+        fprintf(stderr, "Error: invalid number of jobs: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+    } else {  // 'h'
+      fprintf(stderr, usage, program);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (argc - optind != 2) {
+    fprintf(stderr, usage, program);
+    exit(EXIT_FAILURE);
+  }
+
+  const char* image_dir = argv[optind];
+  const char* video_file = argv[optind + 1];
+
+  std::vector<std::string> files;
+  if (!list_images(image_dir, &files)) {
+    exit(2);
+  }
+
+  if (files.empty()) {
+    fprintf(stderr, "Error: no images in %s\n", image_dir);
+    exit(2);
+  }
+
+  // Decoders may run ahead of the writer by a couple of frames each;
+  // beyond that they wait, so memory use stays bounded.
+  ReorderBuffer<cv::Mat> reorder(2 * jobs + 2);
+  std::atomic<size_t> next(0);
+  std::atomic<long> decode_stall_us(0);
+
+  auto decode_images = [&] {
+    while (true) {
+      size_t i = next++;
+      if (i >= files.size()) {
+        break;
+      }
+
+      cv::Mat image = cv::imread(files[i], cv::IMREAD_COLOR);
+      if (image.empty()) {
+        fprintf(stderr, "Error: cannot read %s\n", files[i].c_str());
+      }
+
+      Clock::time_point t = Clock::now();
+      bool ok = reorder.put(i, std::move(image));
+      decode_stall_us += static_cast<long>(seconds_since(t) * 1e6);
+      if (!ok) {
+        break;
+      }
+    }
+  };
+
+  Clock::time_point start = Clock::now();
+  std::vector<std::thread> decoders;
+  for (int i = 0; i < jobs; ++i) {
+    decoders.push_back(std::thread(decode_images));
+  }
+
+  // Encoding is the only serial stage; the time this loop waits for the
+  // next frame is time the decoders could not keep up.
+  cv::VideoWriter wrt;
+  cv::Size size;
+  double encode_stall = 0;
+  double encode_time = 0;
+  long written = 0;
+  long skipped = 0;
+  int ret = 0;
+  for (size_t i = 0; i < files.size(); ++i) {
+    cv::Mat image;
+    Clock::time_point t = Clock::now();
+    reorder.take(&image);
+    encode_stall += seconds_since(t);
+    if (image.empty()) {
+      ++skipped;
+      continue;
+    }
+
+    if (!wrt.isOpened()) {
+      size = image.size();
+      int code = cv::VideoWriter::fourcc(fourcc[0], fourcc[1], fourcc[2],
+                                         fourcc[3]);
+      if (!wrt.open(video_file, code, fps, size)) {
+        fprintf(stderr, "Error: cannot open output file %s\n", video_file);
+        ret = 3;
+        break;
+      }
+    }
+
+    if (image.size() != size) {
+      fprintf(stderr, "Warning: %s is %dx%d, resized to %dx%d\n",
+              files[i].c_str(), image.cols, image.rows, size.width,
+              size.height);
+      cv::resize(image, image, size);
+    }
+
+    t = Clock::now();
+    wrt.write(image);
+    encode_time += seconds_since(t);
+    ++written;
+  }
+
+  reorder.close();  // releases the decoders if we stopped early
+  for (auto& thread : decoders) {
+    thread.join();
+  }
+
+  wrt.release();
+  double elapsed = seconds_since(start);
+
+  fprintf(stderr, "Wrote %ld frames in %.2f s (%.2f fps), skipped %ld\n",
+          written, elapsed, written / elapsed, skipped);
+  fprintf(stderr, "Encoding took %.2f s; the writer waited %.2f s for "
+          "decoders, decoders waited %.2f s for the writer\n", encode_time,
+          encode_stall, decode_stall_us.load() / 1e6);
+  return ret != 0 ? ret : (skipped > 0 ? 2 : 0);
+}
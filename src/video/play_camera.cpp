@@ -1,32 +1,387 @@
 // Copyright: This program is released into the public domain.
 
+#include <getopt.h>
+#include <signal.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
 #include <opencv2/opencv.hpp>
+#include "frame_queue.h"
+#include "raw_video.h"
+#include "triple_buffer.h"
 
-int main() {
-  cv::VideoCapture cap(0);  // open the default camera
-  if (!cap.isOpened()) {  // check if we succeeded
-    fprintf(stderr, "Error: failed to open camera\n");
-    return 1;
+static const char* program = "play_camera";
+static const char* version = "0.2.0";
+static const char* usage =
+"Usage: %s [options]\n"
+"\n"
+"Options:\n"
+"  -h, --help                   Print this help message and exit\n"
+"  -v, --version                Print version message and exit\n"
+"  -d, --device <Number>        Camera index (default: 0)\n"
+"  -r, --record <File>          Record raw frames to a file, without\n"
+"                               display, until Ctrl-C\n"
+"  -n, --frames <Number>        Stop recording after N frames\n"
+"      --ring <Number>          Frames buffered in memory while\n"
+"                               recording (default: 16)\n"
+"      --direct                 Bypass the page cache (O_DIRECT)\n"
+"\n";
+
+typedef std::chrono::steady_clock Clock;
+
+typedef struct {
+  int device;
+  const char* record_file;
+  long max_frames;  // 0 means no limit
+  int ring_frames;
+  bool direct;
+} Config;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void request_stop(int) {
+  stop_requested = 1;
+}
+
+typedef struct {
+  cv::Mat image;
+  Clock::time_point captured;  // when the driver handed the frame over
+  long seq;
+} Frame;
+
+// Keep reading frames so the driver queue never backs up; the display
+// side picks the newest one whenever it is ready.
+static void capture_frames(cv::VideoCapture* cap, TripleBuffer<Frame>* frames,
+                           std::atomic<bool>* running) {
+  long seq = 0;
+  while (running->load()) {
+    if (!cap->grab()) {
+      break;
+    }
+
+    Frame& frame = frames->back();
+    frame.captured = Clock::now();
+    if (!cap->retrieve(frame.image)) {  // reuses the slot's buffer
+      break;
+    }
+
+    frame.seq = seq++;
+    frames->publish();
   }
 
-  cv::namedWindow("Camera", 1);
-  while (true) {
-    cv::Mat frame;
-    cap >> frame;  // read a new frame
-    if (frame.empty()) {
+  running->store(false);
+}
+
+// State shared by the recording threads.
+typedef struct {
+  uint8_t* ring;            // ring_frames records, one per slot
+  size_t record_bytes;
+  BoundedQueue<int>* free_slots;
+  BoundedQueue<int>* filled_slots;
+  std::atomic<long> recorded;
+  std::atomic<long> dropped;
+  std::atomic<bool> failed;
+  std::atomic<bool> capturing;
+} Recording;
+
+// Grab frames as fast as the camera delivers them and decode each one
+// straight into a free ring slot. With no free slot, storage has fallen
+// behind: the frame is dropped without even being retrieved.
+static void capture_records(cv::VideoCapture* cap, const RawVideoHeader& header,
+                            long max_frames, Recording* rec) {
+  uint64_t seq = 0;
+  while (!stop_requested && !rec->failed.load()) {
+    if (max_frames > 0 && seq >= static_cast<uint64_t>(max_frames)) {
+      break;
+    }
+
+    if (!cap->grab()) {
       break;
     }
 
-    cv::imshow("Camera", frame);
+    int64_t time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        Clock::now().time_since_epoch()).count();
+    int slot;
+    if (!rec->free_slots->try_pop(&slot)) {
+      ++rec->dropped;
+      ++seq;
+      continue;
+    }
+
+    uint8_t* record = rec->ring + slot * rec->record_bytes;
+    cv::Mat image(header.height, header.width, header.type,
+                  record + kRawFrameHeaderBytes);
+    if (!cap->retrieve(image) ||
+        image.data != record + kRawFrameHeaderBytes) {
+      fprintf(stderr, "Error: camera frame format changed\n");
+      rec->failed.store(true);
+      break;
+    }
+
+    RawFrameHeader frame_header = {seq++, time_ns};
+    memcpy(record, &frame_header, sizeof(frame_header));
+    rec->filled_slots->push(std::move(slot));
+  }
+
+  rec->filled_slots->close();
+  rec->capturing.store(false);
+}
+
+// Write filled slots in capture order. Slots are handed out and returned
+// in ring order, so runs of adjacent slots go out in a single write.
+static void write_records(RawVideoWriter* writer, int ring_frames,
+                          Recording* rec) {
+  int first;
+  bool have_first = rec->filled_slots->pop(&first);
+  while (have_first) {
+    int count = 1;
+    int next;
+    have_first = false;
+    while (first + count < ring_frames && rec->filled_slots->try_pop(&next)) {
+      if (next != first + count) {
+        have_first = true;  // wrapped around; starts the next run
+        break;
+      }
+
+      ++count;
+    }
+
+    if (!writer->write(rec->ring + first * rec->record_bytes, count)) {
+      rec->failed.store(true);
+      break;
+    }
+
+    rec->recorded += count;
+    for (int i = 0; i < count; ++i) {
+      int slot = first + i;
+      rec->free_slots->push(std::move(slot));
+    }
+
+    if (have_first) {
+      first = next;
+    } else {
+      have_first = rec->filled_slots->pop(&first);
+    }
+  }
+}
+
+int record(cv::VideoCapture* cap, const Config& config) {
+  // the first frame tells the real size and type of what retrieve() gives
+  cv::Mat probe;
+  if (!cap->read(probe) || probe.empty()) {
+    fprintf(stderr, "Error: failed to read from camera\n");
+    return 2;
+  }
+
+  RawVideoHeader header;
+  init_raw_header(&header, probe.cols, probe.rows, probe.type(),
+                  probe.elemSize(), cap->get(cv::CAP_PROP_FPS));
+
+  RawVideoWriter writer;
+  if (!writer.open(config.record_file, header, config.direct)) {
+    return 3;
+  }
+
+  uint8_t* ring = RawVideoWriter::allocate_records(header.record_bytes,
+                                                   config.ring_frames);
+  if (ring == nullptr) {
+    return 3;
+  }
+
+  BoundedQueue<int> free_slots(config.ring_frames);
+  BoundedQueue<int> filled_slots(config.ring_frames);
+  for (int i = 0; i < config.ring_frames; ++i) {
+    int slot = i;
+    free_slots.push(std::move(slot));
+  }
+
+  Recording rec;
+  rec.ring = ring;
+  rec.record_bytes = header.record_bytes;
+  rec.free_slots = &free_slots;
+  rec.filled_slots = &filled_slots;
+  rec.recorded.store(0);
+  rec.dropped.store(0);
+  rec.failed.store(false);
+  rec.capturing.store(true);
+
+  fprintf(stderr, "Recording %dx%d, %zu bytes per frame, to %s\n",
+          probe.cols, probe.rows, probe.total() * probe.elemSize(),
+          config.record_file);
+
+  signal(SIGINT, request_stop);
+  Clock::time_point start = Clock::now();
+  std::thread writer_thread(write_records, &writer, config.ring_frames, &rec);
+  std::thread capture_thread(capture_records, cap, header, config.max_frames,
+                             &rec);
+
+  // report once a second, and loudly whenever frames were dropped
+  long reported_drops = 0;
+  while (rec.capturing.load()) {
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    long dropped = rec.dropped.load();
+    fprintf(stderr, "\rRecorded %ld frames, dropped %ld, ring %zu/%d ",
+            rec.recorded.load(), dropped, filled_slots.size(),
+            config.ring_frames);
+    if (dropped > reported_drops) {
+      fprintf(stderr, "\nWarning: storage fell behind, dropped %ld frames\n",
+              dropped - reported_drops);
+      reported_drops = dropped;
+    }
+  }
+
+  capture_thread.join();
+  writer_thread.join();
+  double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+  bool ok = writer.close() && !rec.failed.load();
+  RawVideoWriter::free_records(ring);
+
+  fprintf(stderr, "\nRecorded %ld frames in %.1f s (%.1f fps), "
+          "dropped %ld, ring high water %zu/%d\n", rec.recorded.load(),
+          elapsed, rec.recorded.load() / elapsed, rec.dropped.load(),
+          filled_slots.high_water(), config.ring_frames);
+  return ok ? 0 : 3;
+}
+
+int preview(cv::VideoCapture* cap) {
+  TripleBuffer<Frame> frames;
+  int width = static_cast<int>(cap->get(cv::CAP_PROP_FRAME_WIDTH));
+  int height = static_cast<int>(cap->get(cv::CAP_PROP_FRAME_HEIGHT));
+  if (width > 0 && height > 0) {
+    for (int i = 0; i < 3; ++i) {
+      frames.slot(i).image.create(height, width, CV_8UC3);
+    }
+  }
+
+  std::atomic<bool> running(true);
+  std::thread capturer(capture_frames, cap, &frames, &running);
+
+  cv::namedWindow("Camera", 1);
+  long displayed = 0;
+  long skipped = 0;
+  long last_seq = -1;
+  double latency_sum_ms = 0;
+  double latency_max_ms = 0;
+  double latency_ms = 0;  // of the previous frame, drawn on the next one
+  while (running.load()) {
+    if (!frames.update()) {
+      int key = cv::waitKey(1);
+      if (key == 'q') {  // quit
+        break;
+      }
+
+      continue;
+    }
+
+    Frame& frame = frames.front();
+    skipped += frame.seq - last_seq - 1;
+    last_seq = frame.seq;
+
+    char text[64];
+    snprintf(text, sizeof(text), "latency %.1f ms", latency_ms);
+    cv::putText(frame.image, text, cv::Point(10, 30),
+                cv::FONT_HERSHEY_SIMPLEX, 0.8, cv::Scalar(0, 255, 0), 2);
+    cv::imshow("Camera", frame.image);
 
-    int key = cv::waitKey(30);
+    int key = cv::waitKey(1);  // the window is repainted here
+
+    // capture to display; exposure and driver buffering add to this
+    latency_ms = std::chrono::duration<double, std::milli>(
+        Clock::now() - frame.captured).count();
+    latency_sum_ms += latency_ms;
+    if (latency_ms > latency_max_ms) {
+      latency_max_ms = latency_ms;
+    }
+
+    ++displayed;
     if (key == 'q') {  // quit
       break;
     }
   }
 
-  cap.release();
+  running.store(false);
+  capturer.join();
+
+  if (displayed > 0) {
+    fprintf(stderr, "Displayed %ld frames, skipped %ld stale frames, "
+            "latency mean %.1f ms, max %.1f ms\n", displayed, skipped,
+            latency_sum_ms / displayed, latency_max_ms);
+  }
+
   cv::destroyAllWindows();
   return 0;
 }
+
+int main(int argc, char** argv) {
+  int show_help = 0;
+  int show_version = 0;
+  Config config = {0, nullptr, 0, 16, false};
+
+  static struct option long_options[] = {
+    {"help", no_argument, &show_help, 'h'},
+    {"version", no_argument, &show_version, 'v'},
+    {"device", required_argument, 0, 'd'},
+    {"record", required_argument, 0, 'r'},
+    {"frames", required_argument, 0, 'n'},
+    {"ring", required_argument, 0, 0},
+    {"direct", no_argument, 0, 0},
+    {0, 0, 0, 0}
+  };
+
+  while (true) {
+    int opt_index = 0;
+    int opt = getopt_long(argc, argv, "hvd:r:n:", long_options, &opt_index);
+    if (opt == -1) {
+      break;
+    } else if (opt == 0) {
+      const char* name = long_options[opt_index].name;
+      if (strcmp(name, "ring") == 0) {
+        config.ring_frames = atoi(optarg);
+        if (config.ring_frames < 2) {
+          fprintf(stderr, "Error: invalid ring size: %s\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+      } else if (strcmp(name, "direct") == 0) {
+        config.direct = true;
+      }
+    } else if (opt == 'h') {
+      printf(usage, program);
+      exit(EXIT_SUCCESS);
+    } else if (opt == 'v') {
+      printf("%s version %s\n", program, version);
+      exit(EXIT_SUCCESS);
+    } else if (opt == 'd') {
+      config.device = atoi(optarg);
+    } else if (opt == 'r') {
+      config.record_file = optarg;
+    } else if (opt == 'n') {
+      config.max_frames = atol(optarg);
+      if (config.max_frames < 1) {
+        fprintf(stderr, "Error: invalid number of frames: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+    } else {  // 'h'
+      fprintf(stderr, usage, program);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (argc != optind) {
+    fprintf(stderr, usage, program);
+    exit(EXIT_FAILURE);
+  }
+
+  cv::VideoCapture cap(config.device);  // open the camera
+  if (!cap.isOpened()) {  // check if we succeeded
+    fprintf(stderr, "Error: failed to open camera\n");
+    return 1;
+  }
+
+  int ret = config.record_file != nullptr ? record(&cap, config)
+                                          : preview(&cap);
+  cap.release();
+  return ret;
+}
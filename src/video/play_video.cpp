@@ -1,63 +1,322 @@
 // Copyright: This program is released into the public domain.
 
+#include <getopt.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <chrono>
 #include <string>
+#include <thread>
+#include <vector>
 #include <opencv2/opencv.hpp>
+#include "frame_queue.h"
+#include "video_props.h"
 
-std::string fourcc_to_string(uint32_t fourcc) {
-  char buf[5] = {0, 0, 0, 0, 0};
-  buf[0] = static_cast<char>(fourcc & 0xff);
-  buf[1] = static_cast<char>((fourcc >> 8) & 0xff);
-  buf[2] = static_cast<char>((fourcc >> 16) & 0xff);
-  buf[3] = static_cast<char>((fourcc >> 24) & 0xff);
-  return buf;
+static const char* program = "play_video";
+static const char* version = "0.2.0";
+static const char* usage =
+"Usage: %s [options] input_file\n"
+"\n"
+"Options:\n"
+"  -h, --help                   Print this help message and exit\n"
+"  -v, --version                Print version message and exit\n"
+"  -B, --benchmark              Decode as fast as possible, without\n"
+"                               display, and print decode statistics\n"
+"  -j, --jobs <Number>          Benchmark: split the video into N\n"
+"                               segments decoded on N threads\n"
+"\n";
+
+// Decoded frames waiting for display; enough to ride out a slow frame
+// without buffering noticeably ahead.
+static const size_t kRingFrames = 4;
+
+typedef std::chrono::steady_clock Clock;
+
+// A decoded frame and its presentation time.
+typedef struct {
+  cv::Mat image;
+  double time_ms;
+} Frame;
+
+// Per-thread results of the decode benchmark.
+typedef struct {
+  long frames;
+  std::vector<double> latencies_ms;  // one per decoded frame
+} DecodeStats;
+
+// Decode frames [begin, end) of a video; end < 0 means up to the last one.
+static void decode_segment(const char* video_file, long begin, long end,
+                           DecodeStats* stats) {
+  stats->frames = 0;
+  cv::VideoCapture cap(video_file);
+  if (!cap.isOpened()) {
+    fprintf(stderr, "Error: failed to open video file\n");
+    return;
+  }
+
+  if (begin > 0) {
+    cap.set(cv::CAP_PROP_POS_FRAMES, begin);
+  }
+
+  cv::Mat frame;
+  for (long i = begin; end < 0 || i < end; ++i) {
+    Clock::time_point t0 = Clock::now();
+    if (!cap.read(frame)) {
+      break;
+    }
+
+    Clock::time_point t1 = Clock::now();
+    stats->latencies_ms.push_back(
+        std::chrono::duration<double, std::milli>(t1 - t0).count());
+    ++stats->frames;
+  }
 }
 
-int main(int argc, char** argv) {
-  if (argc < 2) {
-    fprintf(stderr, "Usage: play_video input_file\n");
-    return 1;
+static double percentile(const std::vector<double>& sorted, double p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+
+  size_t i = static_cast<size_t>(p / 100 * (sorted.size() - 1) + 0.5);
+  return sorted[i];
+}
+
+// Peak resident set size of this process, in MiB.
+static double peak_rss_mb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  return usage.ru_maxrss / (1024.0 * 1024.0);  // bytes
+#else
+  return usage.ru_maxrss / 1024.0;  // kilobytes
+#endif
+}
+
+// Decode the whole video with no display and report throughput.
+// With several segments, each thread opens its own capture, seeks to its
+// first frame and decodes its share, which shows how decoding scales.
+int benchmark_video(const char* video_file, int segments) {
+  long frame_count = 0;
+  if (segments > 1) {
+    cv::VideoCapture cap(video_file);
+    frame_count = static_cast<long>(cap.get(cv::CAP_PROP_FRAME_COUNT));
+    if (frame_count <= 0) {
+      fprintf(stderr, "Error: unknown frame count, cannot split\n");
+      return 1;
+    }
   }
 
-  cv::VideoCapture cap(argv[1]);  // open the video file
+  struct stat sb;
+  double file_mb = stat(video_file, &sb) == 0 ? sb.st_size / 1e6 : 0;
+
+  std::vector<DecodeStats> stats(segments);
+  Clock::time_point start = Clock::now();
+  if (segments == 1) {
+    decode_segment(video_file, 0, -1, &stats[0]);
+  } else {
+    std::vector<std::thread> threads;
+    for (int k = 0; k < segments; ++k) {
+      long begin = frame_count * k / segments;
+      long end = frame_count * (k + 1) / segments;
+      threads.push_back(
+          std::thread(decode_segment, video_file, begin, end, &stats[k]));
+    }
+
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  }
+
+  double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+  long frames = 0;
+  std::vector<double> latencies;
+  for (auto& s : stats) {
+    frames += s.frames;
+    latencies.insert(latencies.end(), s.latencies_ms.begin(),
+                     s.latencies_ms.end());
+  }
+
+  std::sort(latencies.begin(), latencies.end());
+
+  printf("Segments: %d\n", segments);
+  printf("Frames: %ld\n", frames);
+  printf("Time: %.3f s\n", elapsed);
+  printf("Throughput: %.2f frames/s, %.2f MB/s\n", frames / elapsed,
+         file_mb / elapsed);
+  printf("Latency: p50 %.3f ms, p90 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+         percentile(latencies, 50), percentile(latencies, 90),
+         percentile(latencies, 99),
+         latencies.empty() ? 0 : latencies.back());
+  printf("Peak RSS: %.1f MiB\n", peak_rss_mb());
+  return frames > 0 ? 0 : 1;
+}
+
+int play_video(const char* video_file) {
+  cv::VideoCapture cap(video_file);  // open the video file
   if (!cap.isOpened()) {  // check if we succeeded
     fprintf(stderr, "Error: failed to open video file\n");
     return 1;
   }
 
-  int width = static_cast<int>(cap.get(cv::CAP_PROP_FRAME_WIDTH));
-  int height = static_cast<int>(cap.get(cv::CAP_PROP_FRAME_HEIGHT));
-  double fps = cap.get(cv::CAP_PROP_FPS);
-  int frames = static_cast<int>(cap.get(cv::CAP_PROP_FRAME_COUNT));
-  uint32_t fourcc = static_cast<uint32_t>(cap.get(cv::CAP_PROP_FOURCC));
+  VideoProps props;
+  read_capture_props(&cap, &props);
+  const double fps = props.fps;
+
+  printf("Width: %d\n", props.width);
+  printf("Height: %d\n", props.height);
+  printf("FPS: %.2f\n", props.fps);
+  printf("Frames: %ld\n", props.frame_count);
+  printf("Codec: %s\n", props.fourcc.c_str());
+
+  // Decode on a producer thread into recycled buffers, so a slow frame
+  // or a busy UI does not stall the other side.
+  BoundedQueue<Frame> ready(kRingFrames);
+  BoundedQueue<cv::Mat> free_images(kRingFrames + 2);
+  for (size_t i = 0; i < kRingFrames + 2; ++i) {
+    free_images.push(cv::Mat());
+  }
+
+  const double frame_ms = fps > 0 ? 1000.0 / fps : 1000.0 / 30;
+  std::thread decoder([&] {
+    double last_ms = -frame_ms;
+    Frame frame;
+    while (free_images.pop(&frame.image)) {
+      cap >> frame.image;  // read a new frame, reusing the buffer
+      if (frame.image.empty()) {  // see [1]
+        break;
+      }
+
+      // some backends report no timestamps; fall back to the frame rate
+      frame.time_ms = cap.get(cv::CAP_PROP_POS_MSEC);
+      if (frame.time_ms <= last_ms) {
+        frame.time_ms = last_ms + frame_ms;
+      }
+
+      last_ms = frame.time_ms;
+      if (!ready.push(std::move(frame))) {
+        break;
+      }
+    }
+
+    ready.close();
+  });
 
-  printf("Width: %d\n", width);
-  printf("Height: %d\n", height);
-  printf("FPS: %.2f\n", fps);
-  printf("Frames: %d\n", frames);
-  printf("Codec: %s\n", fourcc_to_string(fourcc).c_str());
+  // Show each frame at its presentation time. A frame that is already
+  // more than one frame interval late is dropped if the next one is ready.
+  long displayed = 0;
+  long dropped = 0;
+  long late = 0;
+  bool started = false;
+  Clock::time_point start_time;
+  double start_ms = 0;
 
   cv::namedWindow("Video", 1);
-  while (true) {
-    cv::Mat frame;
-    cap >> frame;  // read a new frame
-    if (frame.empty()) {  // see [1]
-      break;
+  Frame frame;
+  while (ready.pop(&frame)) {
+    if (!started) {
+      start_time = Clock::now();
+      start_ms = frame.time_ms;
+      started = true;
+    }
+
+    Clock::time_point due = start_time +
+        std::chrono::microseconds(
+            static_cast<int64_t>((frame.time_ms - start_ms) * 1000));
+    double delay_ms = std::chrono::duration<double, std::milli>(
+        due - Clock::now()).count();
+
+    if (delay_ms < -frame_ms && ready.size() > 0) {
+      ++dropped;
+      free_images.push(std::move(frame.image));
+      continue;
+    }
+
+    int key = -1;
+    if (delay_ms >= 1) {
+      key = cv::waitKey(static_cast<int>(delay_ms));  // handles UI events
+    } else if (delay_ms < -frame_ms) {
+      ++late;
     }
 
-    cv::imshow("Video", frame);
+    if (key != 'q') {
+      cv::imshow("Video", frame.image);
+      ++displayed;
+      key = cv::waitKey(1);
+    }
 
-    int key = cv::waitKey(30);
+    free_images.push(std::move(frame.image));
     if (key == 'q') {  // quit
       break;
     }
   }
 
+  free_images.close();  // stop the decoder if we quit early
+  ready.close();
+  decoder.join();
+
+  printf("Displayed: %ld\n", displayed);
+  printf("Dropped: %ld\n", dropped);
+  printf("Late: %ld\n", late);
+
   cap.release();
   cv::destroyAllWindows();
   return 0;
 }
 
+int main(int argc, char** argv) {
+  int show_help = 0;
+  int show_version = 0;
+  bool benchmark = false;
+  int segments = 1;
+
+  static struct option long_options[] = {
+    {"help", no_argument, &show_help, 'h'},
+    {"version", no_argument, &show_version, 'v'},
+    {"benchmark", no_argument, 0, 'B'},
+    {"jobs", required_argument, 0, 'j'},
+    {0, 0, 0, 0}
+  };
+
+  while (true) {
+    int opt = getopt_long(argc, argv, "hvBj:", long_options, nullptr);
+    if (opt == -1) {
+      break;
+    } else if (opt == 'h') {
+      printf(usage, program);
+      exit(EXIT_SUCCESS);
+    } else if (opt == 'v') {
+      printf("%s version %s\n", program, version);
+      exit(EXIT_SUCCESS);
+    } else if (opt == 'B') {
+      benchmark = true;
+    } else if (opt == 'j') {
+      segments = atoi(optarg);
+      if (segments < 1) {
+        fprintf(stderr, "Error: invalid number of jobs: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+    } else {  // 'h'
+      fprintf(stderr, usage, program);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (argc - optind != 1) {
+    fprintf(stderr, usage, program);
+    exit(EXIT_FAILURE);
+  }
+
+  const char* video_file = argv[optind];
+  if (benchmark) {
+    return benchmark_video(video_file, segments);
+  }
+
+  return play_video(video_file);
+}
+
 // [1] The result of cv::imread, cv::VideoCapture::read
 // can be determined by the output Mat's properties:
 // Success: cols >  0, rows >  0, data != NULL, empty() == 0
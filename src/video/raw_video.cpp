@@ -0,0 +1,118 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "raw_video.h"
+
+static const char kRawMagic[8] = {'C', 'V', 'R', 'A', 'W', 'V', 'I', 'D'};
+
+static_assert(sizeof(RawVideoHeader) <= kRawAlign, "header too large");
+static_assert(sizeof(RawFrameHeader) <= kRawFrameHeaderBytes,
+              "frame header too large");
+
+void init_raw_header(RawVideoHeader* header, int width, int height, int type,
+                     size_t elem_size, double fps) {
+  memset(header, 0, sizeof(*header));
+  memcpy(header->magic, kRawMagic, sizeof(kRawMagic));
+  header->width = width;
+  header->height = height;
+  header->type = type;
+  header->frame_bytes = static_cast<uint64_t>(width) * height * elem_size;
+  header->record_bytes = (kRawFrameHeaderBytes + header->frame_bytes +
+                          kRawAlign - 1) / kRawAlign * kRawAlign;
+  header->fps = fps;
+}
+
+RawVideoWriter::RawVideoWriter() : fd_(-1), record_bytes_(0) {}
+
+RawVideoWriter::~RawVideoWriter() {
+  if (fd_ != -1) {
+    close();
+  }
+}
+
+static bool write_all(int fd, const uint8_t* data, size_t length) {
+  while (length > 0) {
+    ssize_t n = ::write(fd, data, length);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      fprintf(stderr, "Error: write failed: %s\n", strerror(errno));
+      return false;
+    }
+
+    data += n;
+    length -= n;
+  }
+
+  return true;
+}
+
+bool RawVideoWriter::open(const char* path, const RawVideoHeader& header,
+                          bool direct) {
+  int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+  if (direct) {
+    flags |= O_DIRECT;
+  }
+#endif
+
+  fd_ = ::open(path, flags, 0644);
+  if (fd_ == -1) {
+    fprintf(stderr, "Error: cannot open %s: %s\n", path, strerror(errno));
+    return false;
+  }
+
+#if !defined(O_DIRECT) && defined(F_NOCACHE)
+  if (direct) {
+    fcntl(fd_, F_NOCACHE, 1);  // the macOS equivalent
+  }
+#endif
+
+  record_bytes_ = header.record_bytes;
+
+  // the header block goes through the same aligned path as the records
+  uint8_t* block = allocate_records(kRawAlign, 1);
+  if (block == nullptr) {
+    return false;
+  }
+
+  memcpy(block, &header, sizeof(header));
+  bool ok = write_all(fd_, block, kRawAlign);
+  free_records(block);
+  return ok;
+}
+
+bool RawVideoWriter::write(const uint8_t* records, size_t count) {
+  return fd_ != -1 && write_all(fd_, records, count * record_bytes_);
+}
+
+bool RawVideoWriter::close() {
+  if (fd_ == -1) {
+    return false;
+  }
+
+  bool ok = ::close(fd_) == 0;
+  fd_ = -1;
+  return ok;
+}
+
+uint8_t* RawVideoWriter::allocate_records(size_t record_bytes, size_t count) {
+  void* p = nullptr;
+  if (posix_memalign(&p, kRawAlign, record_bytes * count) != 0) {
+    fprintf(stderr, "Error: cannot allocate %zu bytes\n",
+            record_bytes * count);
+    return nullptr;
+  }
+
+  memset(p, 0, record_bytes * count);
+  return static_cast<uint8_t*>(p);
+}
+
+void RawVideoWriter::free_records(uint8_t* records) {
+  free(records);
+}
@@ -0,0 +1,67 @@
+#ifndef _RAW_VIDEO_H_
+#define _RAW_VIDEO_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A raw recording holds uncompressed frames in fixed-size records:
+//
+//   RawVideoHeader                  zero-padded to kRawAlign bytes
+//   record 0, record 1, ...         record_bytes each
+//
+// A record is a RawFrameHeader, zero-padded to kRawFrameHeaderBytes,
+// followed by the frame rows, tightly packed, and zero padding up to
+// record_bytes, a multiple of kRawAlign. Frame i therefore starts at
+// kRawAlign + i * record_bytes, and every write stays aligned, as
+// O_DIRECT requires. Integers are in host byte order.
+
+static const size_t kRawAlign = 4096;
+static const size_t kRawFrameHeaderBytes = 64;
+
+typedef struct {
+  char magic[8];          // "CVRAWVID"
+  uint32_t width;
+  uint32_t height;
+  int32_t type;           // OpenCV type, e.g. CV_8UC3
+  uint32_t reserved;
+  uint64_t frame_bytes;   // height * width * bytes per pixel
+  uint64_t record_bytes;
+  double fps;             // as reported by the camera; 0 if unknown
+} RawVideoHeader;
+
+typedef struct {
+  uint64_t seq;           // capture number; gaps are dropped frames
+  int64_t time_ns;        // steady clock time when the frame was grabbed
+} RawFrameHeader;
+
+// Fill in a header; record_bytes is derived from the frame size.
+void init_raw_header(RawVideoHeader* header, int width, int height, int type,
+                     size_t elem_size, double fps);
+
+// Writes whole records with plain write(2) calls on a file descriptor,
+// bypassing stdio so that large, aligned buffers go straight to the kernel.
+class RawVideoWriter {
+ public:
+  RawVideoWriter();
+  ~RawVideoWriter();
+
+  // With direct, the page cache is bypassed (O_DIRECT) where supported.
+  bool open(const char* path, const RawVideoHeader& header, bool direct);
+  // Write count consecutive records starting at records, which must be
+  // aligned to kRawAlign.
+  bool write(const uint8_t* records, size_t count);
+  bool close();
+
+  // Records for the writer, aligned to kRawAlign and zeroed.
+  static uint8_t* allocate_records(size_t record_bytes, size_t count);
+  static void free_records(uint8_t* records);
+
+ private:
+  RawVideoWriter(const RawVideoWriter&);
+  RawVideoWriter& operator=(const RawVideoWriter&);
+
+  int fd_;
+  size_t record_bytes_;
+};
+
+#endif  // _RAW_VIDEO_H_
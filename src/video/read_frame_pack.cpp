@@ -0,0 +1,156 @@
+// Copyright: This program is released into the public domain.
+
+// List, check or extract the frames of a pack file written by
+// unpack_video --pack.
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "frame_pack.h"
+
+static const char* program = "read_frame_pack";
+static const char* version = "0.1.0";
+static const char* usage =
+    "Usage: %s [options] pack_file [frame ...]\n"
+    "\n"
+    "Lists the index entries of the given frames (all by default)\n"
+    "unless -o or -c is used.\n"
+    "\n"
+    "Options:\n"
+    "  -h, --help                   Print this help message and exit\n"
+    "  -v, --version                Print version message and exit\n"
+    "  -a, --all                    Select every frame in the pack\n"
+    "  -o, --output <Dir>           Extract frames to Dir/%%08u.jpg\n"
+    "  -c, --check                  Decode the frames and print their size\n"
+    "\n";
+
+static bool select_all = false;
+static bool check = false;
+static const char* output_dir = nullptr;
+
+// Copy the encoded bytes as they are; no decoding involved.
+bool extract_frame(const FramePackReader& pack, const PackEntry& entry) {
+  char image_path[1024];
+  snprintf(image_path, sizeof(image_path), "%s/%08u.jpg", output_dir,
+           (unsigned int)entry.frame);
+
+  FILE* f = fopen(image_path, "wb");
+  if (f == nullptr) {
+    fprintf(stderr, "Error: cannot open %s: %s\n", image_path,
+            strerror(errno));
+    return false;
+  }
+
+  size_t bytes = fwrite(pack.data(entry), 1, entry.length, f);
+  if (fclose(f) != 0 || bytes != entry.length) {
+    fprintf(stderr, "Error: failed to write %s\n", image_path);
+    return false;
+  }
+
+  printf("%s\n", image_path);
+  return true;
+}
+
+// Decode straight from the mapping; imdecode reads the Mat header in place.
+bool check_frame(const FramePackReader& pack, const PackEntry& entry) {
+  cv::Mat buf(1, (int)entry.length, CV_8UC1,
+              const_cast<uint8_t*>(pack.data(entry)));
+  cv::Mat image = cv::imdecode(buf, cv::IMREAD_COLOR);
+  if (image.empty()) {
+    fprintf(stderr, "Error: cannot decode frame %lu\n",
+            (unsigned long)entry.frame);
+    return false;
+  }
+
+  printf("%lu: %dx%d\n", (unsigned long)entry.frame, image.cols, image.rows);
+  return true;
+}
+
+int main(int argc, char** argv) {
+  int show_help = 0;
+  int show_version = 0;
+
+  static struct option long_options[] = {
+      {"help", no_argument, &show_help, 'h'},
+      {"version", no_argument, &show_version, 'v'},
+      {"all", no_argument, 0, 'a'},
+      {"output", required_argument, 0, 'o'},
+      {"check", no_argument, 0, 'c'},
+      {0, 0, 0, 0}};
+
+  while (true) {
+    int opt = getopt_long(argc, argv, "hvao:c", long_options, nullptr);
+    if (opt == -1) {
+      break;
+    } else if (opt == 'h') {
+      printf(usage, program);
+      exit(EXIT_SUCCESS);
+    } else if (opt == 'v') {
+      printf("%s version %s\n", program, version);
+      exit(EXIT_SUCCESS);
+    } else if (opt == 'a') {
+      select_all = true;
+    } else if (opt == 'o') {
+      output_dir = optarg;
+    } else if (opt == 'c') {
+      check = true;
+    } else {  // 'h'
+      fprintf(stderr, usage, program);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (argc - optind < 1) {
+    fprintf(stderr, usage, program);
+    exit(EXIT_FAILURE);
+  }
+
+  const char* pack_file = argv[optind++];
+  FramePackReader pack;
+  if (!pack.open(pack_file)) {
+    exit(2);
+  }
+
+  std::vector<const PackEntry*> selected;
+  if (select_all || argc == optind) {
+    for (size_t i = 0; i < pack.size(); ++i) {
+      selected.push_back(&pack.entry(i));
+    }
+  }
+
+  for (int i = optind; i < argc; ++i) {
+    const PackEntry* entry = pack.find(strtoull(argv[i], nullptr, 10));
+    if (entry == nullptr) {
+      fprintf(stderr, "Error: frame %s is not in the pack\n", argv[i]);
+      exit(2);
+    }
+
+    selected.push_back(entry);
+  }
+
+  if (!check && output_dir == nullptr) {
+    printf("%10s %12s %14s %10s\n", "frame", "time_ms", "offset", "length");
+    for (const PackEntry* e : selected) {
+      printf("%10lu %12.3f %14lu %10lu\n", (unsigned long)e->frame,
+             e->time_ms, (unsigned long)e->offset, (unsigned long)e->length);
+    }
+
+    return 0;
+  }
+
+  for (const PackEntry* entry : selected) {
+    if (check && !check_frame(pack, *entry)) {
+      exit(3);
+    }
+
+    if (output_dir != nullptr && !extract_frame(pack, *entry)) {
+      exit(3);
+    }
+  }
+
+  return 0;
+}
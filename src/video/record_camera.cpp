@@ -0,0 +1,278 @@
+// Copyright: This program is released into the public domain.
+
+// Record the camera to a video file, like python/video/record_camera.py,
+// with capture and encoding on separate threads so that a slow encoder
+// drops frames instead of stalling the camera.
+
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <opencv2/opencv.hpp>
+#include "frame_queue.h"
+#include "triple_buffer.h"
+
+static const char* program = "record_camera";
+static const char* version = "0.1.0";
+static const char* usage =
+"Usage: %s [options] [output_file]\n"
+"\n"
+"Records to output.mp4 by default.\n"
+"\n"
+"Options:\n"
+"  -h, --help                   Print this help message and exit\n"
+"  -v, --version                Print version message and exit\n"
+"  -d, --device <Number>        Camera index (default: 0)\n"
+"  -s, --size <W>x<H>           Requested resolution (default: 1920x1080)\n"
+"  -f, --fps <Number>           Requested frame rate (default: 60)\n"
+"  -c, --fourcc <Code>          Output codec (default: avc1)\n"
+"  -q, --queue <Number>         Frames waiting for the encoder before\n"
+"                               new ones are dropped (default: 8)\n"
+"  -n, --no-display             Do not show the video; stop with Ctrl-C\n"
+"\n";
+
+typedef std::chrono::steady_clock Clock;
+
+typedef struct {
+  int device;
+  int width;
+  int height;
+  double fps;
+  const char* fourcc;
+  int queue_frames;
+  bool display;
+} Config;
+
+// Counters shared by the threads.
+typedef struct {
+  std::atomic<long> captured;
+  std::atomic<long> encoded;
+  std::atomic<long> dropped;
+  std::atomic<bool> running;
+} Stats;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void request_stop(int) {
+  stop_requested = 1;
+}
+
+// Never blocks on the encoder: without a free buffer the frame is grabbed
+// and thrown away, so the camera keeps its pace.
+static void capture_frames(cv::VideoCapture* cap,
+                           BoundedQueue<cv::Mat>* free_images,
+                           BoundedQueue<cv::Mat>* pending,
+                           TripleBuffer<cv::Mat>* preview, Stats* stats) {
+  while (stats->running.load() && !stop_requested) {
+    cv::Mat image;
+    if (!free_images->try_pop(&image)) {
+      if (!cap->grab()) {
+        break;
+      }
+
+      ++stats->captured;
+      ++stats->dropped;
+      continue;
+    }
+
+    if (!cap->read(image)) {  // reuses the recycled buffer
+      break;
+    }
+
+    ++stats->captured;
+    if (preview != nullptr) {
+      image.copyTo(preview->back());
+      preview->publish();
+    }
+
+    if (!pending->try_push(std::move(image))) {
+      ++stats->dropped;
+      free_images->push(std::move(image));
+    }
+  }
+
+  stats->running.store(false);
+  pending->close();
+}
+
+static void encode_frames(cv::VideoWriter* wrt,
+                          BoundedQueue<cv::Mat>* free_images,
+                          BoundedQueue<cv::Mat>* pending, Stats* stats) {
+  cv::Mat image;
+  while (pending->pop(&image)) {
+    wrt->write(image);
+    ++stats->encoded;
+    free_images->push(std::move(image));
+  }
+}
+
+static bool parse_size(const char* text, int* width, int* height) {
+  return sscanf(text, "%dx%d", width, height) == 2 && *width > 0 &&
+         *height > 0;
+}
+
+int main(int argc, char** argv) {
+  int show_help = 0;
+  int show_version = 0;
+  Config config = {0, 1920, 1080, 60.0, "avc1", 8, true};
+
+  static struct option long_options[] = {
+    {"help", no_argument, &show_help, 'h'},
+    {"version", no_argument, &show_version, 'v'},
+    {"device", required_argument, 0, 'd'},
+    {"size", required_argument, 0, 's'},
+    {"fps", required_argument, 0, 'f'},
+    {"fourcc", required_argument, 0, 'c'},
+    {"queue", required_argument, 0, 'q'},
+    {"no-display", no_argument, 0, 'n'},
+    {0, 0, 0, 0}
+  };
+
+  while (true) {
+    int opt = getopt_long(argc, argv, "hvd:s:f:c:q:n", long_options, nullptr);
+    if (opt == -1) {
+      break;
+    } else if (opt == 'h') {
+      printf(usage, program);
+      exit(EXIT_SUCCESS);
+    } else if (opt == 'v') {
+      printf("%s version %s\n", program, version);
+      exit(EXIT_SUCCESS);
+    } else if (opt == 'd') {
+      config.device = atoi(optarg);
+    } else if (opt == 's') {
+      if (!parse_size(optarg, &config.width, &config.height)) {
+        fprintf(stderr, "Error: invalid size: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+    } else if (opt == 'f') {
+      config.fps = atof(optarg);
+      if (config.fps <= 0) {
+        fprintf(stderr, "Error: invalid frame rate: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+    } else if (opt == 'c') {
+      if (strlen(optarg) != 4) {
+        fprintf(stderr, "Error: a FourCC has 4 characters: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+
+      config.fourcc = optarg;
+    } else if (opt == 'q') {
+      config.queue_frames = atoi(optarg);
+      if (config.queue_frames < 1) {
+        fprintf(stderr, "Error: invalid queue size: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+    } else if (opt == 'n') {
+      config.display = false;
+    } else {  // 'h'
+      fprintf(stderr, usage, program);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (argc - optind > 1) {
+    fprintf(stderr, usage, program);
+    exit(EXIT_FAILURE);
+  }
+
+  const char* output_file = optind < argc ? argv[optind] : "output.mp4";
+
+  cv::VideoCapture cap(config.device);
+  if (!cap.isOpened()) {
+    fprintf(stderr, "Error: failed to open camera\n");
+    exit(1);
+  }
+
+  // the camera falls back to the nearest mode it supports
+  cap.set(cv::CAP_PROP_FRAME_WIDTH, config.width);
+  cap.set(cv::CAP_PROP_FRAME_HEIGHT, config.height);
+  cap.set(cv::CAP_PROP_FPS, config.fps);
+
+  int width = static_cast<int>(cap.get(cv::CAP_PROP_FRAME_WIDTH));
+  int height = static_cast<int>(cap.get(cv::CAP_PROP_FRAME_HEIGHT));
+  double fps = cap.get(cv::CAP_PROP_FPS);
+  if (fps <= 0) {
+    fps = config.fps;
+  }
+
+  const char* c = config.fourcc;
+  cv::VideoWriter wrt(output_file, cv::VideoWriter::fourcc(c[0], c[1], c[2],
+                                                           c[3]),
+                      fps, cv::Size(width, height));
+  if (!wrt.isOpened()) {
+    fprintf(stderr, "Error: cannot open output file %s\n", output_file);
+    exit(3);
+  }
+
+  fprintf(stderr, "Recording %dx%d at %.2f fps to %s\n", width, height, fps,
+          output_file);
+
+  // one buffer more than the queue holds: the encoder works on it
+  BoundedQueue<cv::Mat> free_images(config.queue_frames + 1);
+  BoundedQueue<cv::Mat> pending(config.queue_frames);
+  for (int i = 0; i < config.queue_frames + 1; ++i) {
+    free_images.push(cv::Mat(height, width, CV_8UC3));
+  }
+
+  TripleBuffer<cv::Mat> preview;
+  Stats stats;
+  stats.captured.store(0);
+  stats.encoded.store(0);
+  stats.dropped.store(0);
+  stats.running.store(true);
+
+  signal(SIGINT, request_stop);
+  Clock::time_point start = Clock::now();
+  std::thread encoder(encode_frames, &wrt, &free_images, &pending, &stats);
+  std::thread capturer(capture_frames, &cap, &free_images, &pending,
+                       config.display ? &preview : nullptr, &stats);
+
+  if (config.display) {
+    cv::namedWindow("video", cv::WINDOW_AUTOSIZE);
+  }
+
+  while (stats.running.load() && !stop_requested) {
+    if (!config.display) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      continue;
+    }
+
+    if (preview.update()) {
+      cv::imshow("video", preview.front());
+    }
+
+    int key = cv::waitKey(10) & 0xff;
+    if (key == 27 || key == 'q') {  // ESC, quit
+      break;
+    }
+  }
+
+  stats.running.store(false);
+  capturer.join();
+  double capture_seconds =
+      std::chrono::duration<double>(Clock::now() - start).count();
+  encoder.join();  // finish what is queued
+  double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+  cap.release();
+  wrt.release();
+  if (config.display) {
+    cv::destroyAllWindows();
+  }
+
+  fprintf(stderr, "Captured %ld frames in %.2f s (%.2f fps)\n",
+          stats.captured.load(), capture_seconds,
+          stats.captured.load() / capture_seconds);
+  fprintf(stderr, "Encoded %ld frames in %.2f s (%.2f fps)\n",
+          stats.encoded.load(), elapsed, stats.encoded.load() / elapsed);
+  fprintf(stderr, "Dropped %ld frames, queue high water %lu/%d\n",
+          stats.dropped.load(), (unsigned long)pending.high_water(),
+          config.queue_frames);
+  return 0;
+}
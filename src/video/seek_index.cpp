@@ -0,0 +1,379 @@
+// Sidecar seek indexes and frame-accurate random access built on them.
+// Refer to:
+// https://ffmpeg.org/doxygen/trunk/group__lavc__encdec.html
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "seek_index.h"
+#include "video_index.h"
+
+#ifdef HAVE_FFMPEG
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libswscale/swscale.h>
+}
+#endif
+
+static const char kSeekMagic[8] = {'C', 'V', 'S', 'E', 'E', 'K', 'X', '1'};
+
+static_assert(sizeof(SeekEntry) == 32, "SeekEntry must not be padded");
+
+bool build_seek_index(const char* video_file, std::vector<SeekEntry>* index) {
+  std::vector<FrameEntry> frames;
+  if (!scan_video_frames(video_file, &frames)) {
+    return false;
+  }
+
+  index->resize(frames.size());
+  int64_t keyframe = 0;  // the first frame decodes as if it were a key frame
+  for (size_t i = 0; i < frames.size(); ++i) {
+    if (frames[i].keyframe) {
+      keyframe = i;
+    }
+
+    SeekEntry& entry = (*index)[i];
+    entry.pts = frames[i].pts;
+    entry.time_ms = frames[i].time_ms;
+    entry.keyframe = keyframe;
+    entry.flags = frames[i].keyframe ? kSeekKeyframe : 0;
+    entry.reserved = 0;
+  }
+
+  return true;
+}
+
+bool write_seek_index(const char* index_file, const char* video_file,
+                      const std::vector<SeekEntry>& index) {
+  struct stat sb;
+  if (stat(video_file, &sb) != 0) {
+    fprintf(stderr, "Error: cannot stat %s: %s\n", video_file,
+            strerror(errno));
+    return false;
+  }
+
+  FILE* f = fopen(index_file, "wb");
+  if (f == nullptr) {
+    fprintf(stderr, "Error: cannot open %s: %s\n", index_file,
+            strerror(errno));
+    return false;
+  }
+
+  uint64_t header[2] = {index.size(), static_cast<uint64_t>(sb.st_size)};
+  int64_t mtime = sb.st_mtime;
+  bool ok = fwrite(kSeekMagic, sizeof(kSeekMagic), 1, f) == 1 &&
+            fwrite(header, sizeof(header), 1, f) == 1 &&
+            fwrite(&mtime, sizeof(mtime), 1, f) == 1 &&
+            fwrite(index.data(), sizeof(SeekEntry), index.size(), f) ==
+                index.size();
+  if (fclose(f) != 0 || !ok) {
+    fprintf(stderr, "Error: failed to write %s\n", index_file);
+    return false;
+  }
+
+  return true;
+}
+
+bool read_seek_index(const char* index_file, const char* video_file,
+                     std::vector<SeekEntry>* index) {
+  FILE* f = fopen(index_file, "rb");
+  if (f == nullptr) {
+    fprintf(stderr, "Error: cannot open %s: %s\n", index_file,
+            strerror(errno));
+    return false;
+  }
+
+  char magic[8];
+  uint64_t header[2];
+  int64_t mtime;
+  if (fread(magic, sizeof(magic), 1, f) != 1 ||
+      memcmp(magic, kSeekMagic, sizeof(magic)) != 0 ||
+      fread(header, sizeof(header), 1, f) != 1 ||
+      fread(&mtime, sizeof(mtime), 1, f) != 1) {
+    fprintf(stderr, "Error: not a seek index: %s\n", index_file);
+    fclose(f);
+    return false;
+  }
+
+  struct stat sb;
+  if (stat(video_file, &sb) != 0 ||
+      static_cast<uint64_t>(sb.st_size) != header[1] || sb.st_mtime != mtime) {
+    fprintf(stderr, "Error: %s is out of date for %s\n", index_file,
+            video_file);
+    fclose(f);
+    return false;
+  }
+
+  // the entry count must match the file size before anything is allocated
+  // for it
+  struct stat index_sb;
+  const uint64_t header_bytes = sizeof(magic) + sizeof(header) +
+                                sizeof(mtime);
+  if (fstat(fileno(f), &index_sb) != 0 ||
+      static_cast<uint64_t>(index_sb.st_size) < header_bytes ||
+      (static_cast<uint64_t>(index_sb.st_size) - header_bytes) %
+              sizeof(SeekEntry) != 0 ||
+      (static_cast<uint64_t>(index_sb.st_size) - header_bytes) /
+              sizeof(SeekEntry) != header[0]) {
+    fprintf(stderr, "Error: truncated seek index: %s\n", index_file);
+    fclose(f);
+    return false;
+  }
+
+  index->resize(header[0]);
+  bool ok = fread(index->data(), sizeof(SeekEntry), index->size(), f) ==
+            index->size();
+  fclose(f);
+  if (!ok) {
+    fprintf(stderr, "Error: truncated seek index: %s\n", index_file);
+    index->clear();
+    return false;
+  }
+
+  return true;
+}
+
+#ifdef HAVE_FFMPEG
+
+// Demuxes and decodes the video stream directly, so that each decoded
+// frame can be identified by its timestamp.
+struct IndexedVideoReader::Decoder {
+  AVFormatContext* fmt = nullptr;
+  AVCodecContext* ctx = nullptr;
+  AVFrame* frame = nullptr;
+  AVPacket* pkt = nullptr;
+  SwsContext* sws = nullptr;
+  int stream = -1;
+  bool flushing = false;  // end of file reached, draining the decoder
+
+  ~Decoder() {
+    sws_freeContext(sws);
+    av_packet_free(&pkt);
+    av_frame_free(&frame);
+    avcodec_free_context(&ctx);
+    avformat_close_input(&fmt);
+  }
+
+  bool open(const char* video_file) {
+#if LIBAVFORMAT_VERSION_INT < AV_VERSION_INT(58, 9, 100)
+    av_register_all();
+#endif
+
+    if (avformat_open_input(&fmt, video_file, nullptr, nullptr) < 0 ||
+        avformat_find_stream_info(fmt, nullptr) < 0) {
+      fprintf(stderr, "Error: cannot demux %s\n", video_file);
+      return false;
+    }
+
+    stream = av_find_best_stream(fmt, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (stream < 0) {
+      fprintf(stderr, "Error: no video stream in %s\n", video_file);
+      return false;
+    }
+
+    const AVCodecParameters* par = fmt->streams[stream]->codecpar;
+    const AVCodec* codec = avcodec_find_decoder(par->codec_id);
+    ctx = avcodec_alloc_context3(codec);
+    if (codec == nullptr || ctx == nullptr ||
+        avcodec_parameters_to_context(ctx, par) < 0) {
+      fprintf(stderr, "Error: no decoder for %s\n", video_file);
+      return false;
+    }
+
+    ctx->thread_count = 0;  // let the decoder pick
+    if (avcodec_open2(ctx, codec, nullptr) < 0) {
+      fprintf(stderr, "Error: cannot open decoder for %s\n", video_file);
+      return false;
+    }
+
+    frame = av_frame_alloc();
+    pkt = av_packet_alloc();
+    return frame != nullptr && pkt != nullptr;
+  }
+
+  bool seek(const SeekEntry& key) {
+    if (av_seek_frame(fmt, stream, key.pts, AVSEEK_FLAG_BACKWARD) < 0) {
+      return false;
+    }
+
+    avcodec_flush_buffers(ctx);
+    flushing = false;
+    return true;
+  }
+
+  // Decode the next frame and tell which frame of the index it is.
+  bool next(const std::vector<SeekEntry>& index, int64_t* n) {
+    while (true) {
+      int ret = avcodec_receive_frame(ctx, frame);
+      if (ret == 0) {
+        break;
+      } else if (ret != AVERROR(EAGAIN) || flushing) {
+        return false;
+      }
+
+      while ((ret = av_read_frame(fmt, pkt)) >= 0 &&
+             pkt->stream_index != stream) {
+        av_packet_unref(pkt);
+      }
+
+      if (ret < 0) {
+        avcodec_send_packet(ctx, nullptr);  // drain delayed frames
+        flushing = true;
+        continue;
+      }
+
+      ret = avcodec_send_packet(ctx, pkt);
+      av_packet_unref(pkt);
+      if (ret < 0 && ret != AVERROR(EAGAIN)) {
+        return false;
+      }
+    }
+
+    int64_t pts = frame->best_effort_timestamp;
+    auto it = std::lower_bound(index.begin(), index.end(), pts,
+                               [](const SeekEntry& e, int64_t value) {
+                                 return e.pts < value;
+                               });
+    *n = it - index.begin();
+    return true;
+  }
+
+  bool retrieve(cv::Mat* image) {
+    sws = sws_getCachedContext(sws, frame->width, frame->height,
+                               static_cast<AVPixelFormat>(frame->format),
+                               frame->width, frame->height, AV_PIX_FMT_BGR24,
+                               SWS_BILINEAR, nullptr, nullptr, nullptr);
+    if (sws == nullptr) {
+      return false;
+    }
+
+    image->create(frame->height, frame->width, CV_8UC3);
+    uint8_t* dst[1] = {image->data};
+    int dst_stride[1] = {static_cast<int>(image->step)};
+    sws_scale(sws, frame->data, frame->linesize, 0, frame->height, dst,
+              dst_stride);
+    return true;
+  }
+};
+
+#else
+
+// Without FFmpeg, frames are counted from the position VideoCapture
+// reports after a seek, which is only as accurate as its POS_FRAMES.
+struct IndexedVideoReader::Decoder {
+  cv::VideoCapture cap;
+  int64_t position = 0;
+
+  bool open(const char* video_file) {
+    if (!cap.open(video_file)) {
+      fprintf(stderr, "Error: failed to open %s\n", video_file);
+      return false;
+    }
+
+    return true;
+  }
+
+  bool seek(const SeekEntry& key) {
+    cap.set(cv::CAP_PROP_POS_FRAMES, static_cast<double>(key.keyframe));
+    position = key.keyframe;
+    return true;
+  }
+
+  bool next(const std::vector<SeekEntry>& index, int64_t* n) {
+    if (!cap.grab()) {
+      return false;
+    }
+
+    *n = position++;
+    return true;
+  }
+
+  bool retrieve(cv::Mat* image) { return cap.retrieve(*image); }
+};
+
+#endif  // HAVE_FFMPEG
+
+IndexedVideoReader::IndexedVideoReader()
+    : decoder_(nullptr), next_(-1), decoded_(0), seeks_(0) {}
+
+IndexedVideoReader::~IndexedVideoReader() {
+  close();
+}
+
+bool IndexedVideoReader::open(const char* video_file,
+                              const char* index_file) {
+  close();
+
+  std::string default_index = std::string(video_file) + ".idx";
+  if (index_file == nullptr) {
+    index_file = default_index.c_str();
+  }
+
+  if (!read_seek_index(index_file, video_file, &index_)) {
+    return false;
+  }
+
+  decoder_ = new Decoder();
+  if (!decoder_->open(video_file)) {
+    close();
+    return false;
+  }
+
+  next_ = 0;
+  return true;
+}
+
+void IndexedVideoReader::close() {
+  delete decoder_;
+  decoder_ = nullptr;
+  index_.clear();
+  next_ = -1;
+}
+
+bool IndexedVideoReader::read(int64_t n, cv::Mat* image) {
+  if (decoder_ == nullptr || n < 0 || n >= static_cast<int64_t>(size())) {
+    return false;
+  }
+
+  // decoding forward beats seeking as long as the target is ahead and the
+  // decoder is already past the key frame the target depends on
+  int64_t key = index_[n].keyframe;
+  if (next_ < key || next_ > n) {
+    if (!decoder_->seek(index_[key])) {
+      fprintf(stderr, "Error: cannot seek to frame %ld\n", (long)key);
+      next_ = -1;
+      return false;
+    }
+
+    next_ = key;
+    ++seeks_;
+  }
+
+  while (true) {
+    int64_t frame;
+    if (!decoder_->next(index_, &frame)) {
+      fprintf(stderr, "Error: cannot decode frame %ld\n", (long)n);
+      next_ = -1;
+      return false;
+    }
+
+    ++decoded_;
+    if (frame == n) {
+      next_ = n + 1;
+      return decoder_->retrieve(image);
+    } else if (frame > n) {
+      fprintf(stderr, "Error: frame %ld was not found after seeking\n",
+              (long)n);
+      next_ = -1;
+      return false;
+    }
+
+    next_ = frame + 1;
+  }
+}
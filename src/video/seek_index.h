@@ -0,0 +1,77 @@
+#ifndef _SEEK_INDEX_H_
+#define _SEEK_INDEX_H_
+
+#include <stdint.h>
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+// One frame of a seek index, in presentation order.
+typedef struct {
+  int64_t pts;        // presentation timestamp, in stream time base units
+  double time_ms;     // presentation time from the first frame
+  int64_t keyframe;   // nearest key frame at or before this frame
+  uint32_t flags;     // kSeekKeyframe
+  uint32_t reserved;
+} SeekEntry;
+
+static const uint32_t kSeekKeyframe = 0x1;
+
+// A seek index is a sidecar file, by default video_file + ".idx":
+//
+//   "CVSEEKX1"                      8-byte magic
+//   count, source size              two uint64
+//   source mtime                    int64, seconds
+//   index                           count x SeekEntry
+//
+// Integers are in host byte order. The source size and mtime let readers
+// notice that the video has changed since it was indexed.
+
+// Scan a video once, without decoding it (needs FFmpeg).
+bool build_seek_index(const char* video_file, std::vector<SeekEntry>* index);
+
+bool write_seek_index(const char* index_file, const char* video_file,
+                      const std::vector<SeekEntry>& index);
+
+// Fails if the index is unreadable or older than the video it describes.
+bool read_seek_index(const char* index_file, const char* video_file,
+                     std::vector<SeekEntry>* index);
+
+// Reads arbitrary frames of a video using its seek index: it seeks to the
+// key frame a frame depends on and decodes forward from there, or just
+// decodes forward when the frame lies ahead in the current group of
+// pictures. With FFmpeg, frames are matched by timestamp, so the frame
+// returned is exactly the one asked for.
+class IndexedVideoReader {
+ public:
+  IndexedVideoReader();
+  ~IndexedVideoReader();
+
+  // index_file may be nullptr for video_file + ".idx".
+  bool open(const char* video_file, const char* index_file = nullptr);
+  void close();
+
+  size_t size() const { return index_.size(); }
+  const SeekEntry& entry(size_t i) const { return index_[i]; }
+
+  // Decode frame n as 8-bit BGR.
+  bool read(int64_t n, cv::Mat* image);
+
+  // Frames decoded so far, including the ones decoded only to reach a
+  // requested frame, and the number of seeks.
+  long decoded() const { return decoded_; }
+  long seeks() const { return seeks_; }
+
+ private:
+  IndexedVideoReader(const IndexedVideoReader&);
+  IndexedVideoReader& operator=(const IndexedVideoReader&);
+
+  struct Decoder;
+
+  std::vector<SeekEntry> index_;
+  Decoder* decoder_;
+  int64_t next_;  // frame the decoder returns next; -1 if unknown
+  long decoded_;
+  long seeks_;
+};
+
+#endif  // _SEEK_INDEX_H_
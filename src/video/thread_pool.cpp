@@ -0,0 +1,144 @@
+#include <utility>
+#include "thread_pool.h"
+
+// The pool and index of the worker running on this thread, if any.
+static thread_local ThreadPool* current_pool = nullptr;
+static thread_local int current_worker = -1;
+
+ThreadPool::ThreadPool(int threads)
+    : next_worker_(0), queued_(0), unfinished_(0), stopping_(false) {
+  if (threads < 1) {
+    threads = 1;
+  }
+
+  for (int i = 0; i < threads; ++i) {
+    workers_.push_back(std::unique_ptr<Worker>(new Worker()));
+  }
+
+  for (int i = 0; i < threads; ++i) {
+    threads_.push_back(std::thread(&ThreadPool::work, this, i));
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  wait();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+
+  has_tasks_.notify_all();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+  int index = current_pool == this
+                  ? current_worker
+                  : static_cast<int>(next_worker_++ % workers_.size());
+  {
+    // Counted before the task is visible: otherwise another worker could
+    // steal and finish it first, and unfinished_ would reach 0 early.
+    // Under mutex_ so that a worker about to sleep cannot miss it.
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++unfinished_;
+    ++queued_;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(workers_[index]->mutex);
+    workers_[index]->tasks.push_back(std::move(task));
+  }
+
+  has_tasks_.notify_one();
+}
+
+void ThreadPool::submit_top_level(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    top_level_.push_back(std::move(task));
+    ++unfinished_;
+  }
+
+  has_tasks_.notify_one();
+}
+
+bool ThreadPool::pop_or_steal(int index, std::function<void()>* task) {
+  const int n = static_cast<int>(workers_.size());
+  for (int k = 0; k < n; ++k) {
+    Worker* worker = workers_[(index + k) % n].get();
+    std::lock_guard<std::mutex> lock(worker->mutex);
+    if (worker->tasks.empty()) {
+      continue;
+    }
+
+    if (k == 0) {  // our own deque: newest first
+      *task = std::move(worker->tasks.back());
+      worker->tasks.pop_back();
+    } else {  // someone else's: oldest first
+      *task = std::move(worker->tasks.front());
+      worker->tasks.pop_front();
+    }
+
+    --queued_;
+    return true;
+  }
+
+  return false;
+}
+
+bool ThreadPool::run_pending() {
+  int index = current_pool == this ? current_worker : 0;
+  std::function<void()> task;
+  if (!pop_or_steal(index, &task)) {
+    return false;
+  }
+
+  task();
+  finish_task();
+  return true;
+}
+
+void ThreadPool::finish_task() {
+  bool idle;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    idle = --unfinished_ == 0;
+  }
+
+  if (idle) {
+    all_done_.notify_all();
+  }
+}
+
+void ThreadPool::wait() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  all_done_.wait(lock, [this] { return unfinished_ == 0; });
+}
+
+void ThreadPool::work(int index) {
+  current_pool = this;
+  current_worker = index;
+  while (true) {
+    if (run_pending()) {
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    has_tasks_.wait(lock, [this] {
+      return stopping_ || queued_ > 0 || !top_level_.empty();
+    });
+    if (queued_ > 0) {
+      continue;
+    } else if (!top_level_.empty()) {
+      std::function<void()> task = std::move(top_level_.front());
+      top_level_.pop_front();
+      lock.unlock();
+      task();
+      finish_task();
+    } else if (stopping_) {
+      break;
+    }
+  }
+}
@@ -0,0 +1,69 @@
+#ifndef _THREAD_POOL_H_
+#define _THREAD_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads with one task deque each. A worker runs
+// the newest task of its own deque first, which keeps the data it just
+// produced in cache, and steals the oldest task of another worker when
+// its own deque is empty. A task that would block waiting for other
+// tasks should call run_pending() instead, so that the number of busy
+// threads never exceeds the size of the pool. Long tasks that spawn
+// others go through submit_top_level(), so that they never start nested
+// inside a task that is only helping out while it waits.
+class ThreadPool {
+ public:
+  explicit ThreadPool(int threads);
+  // Waits for every task to finish.
+  ~ThreadPool();
+
+  // Queue a task. From a worker it goes to that worker's own deque,
+  // otherwise the deques take turns.
+  void submit(std::function<void()> task);
+
+  // Queue a task that only an idle worker starts, after every task queued
+  // with submit(); run_pending() never runs it.
+  void submit_top_level(std::function<void()> task);
+
+  // Run one queued task on the calling thread. Returns false if there
+  // was none.
+  bool run_pending();
+
+  // Block until every submitted task has finished.
+  void wait();
+
+  int size() const { return static_cast<int>(workers_.size()); }
+
+ private:
+  ThreadPool(const ThreadPool&);
+  ThreadPool& operator=(const ThreadPool&);
+
+  typedef struct {
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+  } Worker;
+
+  void work(int index);
+  bool pop_or_steal(int index, std::function<void()>* task);
+  void finish_task();
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::vector<std::thread> threads_;
+  std::atomic<unsigned> next_worker_;  // for tasks from other threads
+  std::atomic<long> queued_;
+  std::deque<std::function<void()>> top_level_;
+  long unfinished_;                    // queued or running
+  bool stopping_;
+  std::mutex mutex_;                   // guards the three above
+  std::condition_variable has_tasks_;
+  std::condition_variable all_done_;
+};
+
+#endif  // _THREAD_POOL_H_
@@ -0,0 +1,56 @@
+#ifndef _TRIPLE_BUFFER_H_
+#define _TRIPLE_BUFFER_H_
+
+#include <stdint.h>
+#include <atomic>
+
+// Hands the most recent item from one producer thread to one consumer
+// thread without locks. Of the three slots, the producer fills one, the
+// consumer reads another and the third holds the latest published item.
+// Publishing swaps the filled slot with the middle one, so the producer
+// never waits and the consumer only ever sees the newest item; older
+// unread items are overwritten in place. Slots are reused, so items such
+// as cv::Mat keep their buffers from one round to the next.
+template <typename T>
+class TripleBuffer {
+ public:
+  TripleBuffer() : middle_(1), back_(0), front_(2) {}
+
+  // The slot the producer fills before calling publish().
+  T& back() { return slots_[back_]; }
+
+  // Make back() the latest item and get a stale slot to fill next.
+  void publish() {
+    uint8_t prev = middle_.exchange(back_ | kFresh, std::memory_order_acq_rel);
+    back_ = prev & kIndexMask;
+  }
+
+  // Returns true, making it front(), if an item was published since the
+  // last call.
+  bool update() {
+    if ((middle_.load(std::memory_order_relaxed) & kFresh) == 0) {
+      return false;
+    }
+
+    uint8_t prev = middle_.exchange(front_, std::memory_order_acq_rel);
+    front_ = prev & kIndexMask;
+    return true;
+  }
+
+  // The slot the consumer reads; stays valid until the next update().
+  T& front() { return slots_[front_]; }
+
+  // For preallocating buffers before the threads start.
+  T& slot(int i) { return slots_[i]; }
+
+ private:
+  static const uint8_t kIndexMask = 0x3;
+  static const uint8_t kFresh = 0x4;
+
+  T slots_[3];
+  std::atomic<uint8_t> middle_;  // index of the middle slot, plus kFresh
+  uint8_t back_;                 // owned by the producer
+  uint8_t front_;                // owned by the consumer
+};
+
+#endif  // _TRIPLE_BUFFER_H_
@@ -3,22 +3,79 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <errno.h>
 #include <getopt.h>
+#include <math.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+#include <set>
+#include <string>
 #include <vector>
 #include <opencv2/opencv.hpp>
+#include "frame_hash.h"
+#include "frame_pack.h"
+#include "frame_queue.h"
+#include "thread_pool.h"
+#include "video_index.h"
 
 static const char* program = "unpack_video";
-static const char* version = "0.1.0";
-static const char* usage = "Usage: %s [options] video_file image_dir\n"
+static const char* version = "0.6.0";
+static const char* usage =
+"Usage: %s [options] video_file image_dir\n"
+"       %s [options] --pack video_file pack_file\n"
+"       %s [options] --batch output_dir video_file ...\n"
 "\n"
 "Options:\n"
 "  -h, --help                   Print this help message and exit\n"
 "  -v, --version                Print version message and exit\n"
 "  -Q, --quality <Number>       Set image quality (0-100, default: 95)\n"
+"  -j, --jobs <Number>          Number of encoder threads (default: 1);\n"
+"                               with --batch, the total number of threads\n"
+"  -P, --pack                   Append frames to one pack file instead of\n"
+"                               writing image_dir/%%08u.jpg\n"
+"  -b, --batch <Dir>            Unpack each video to Dir/<name>/, or to\n"
+"                               Dir/<name>.pack with --pack, sharing the\n"
+"                               threads between all the videos\n"
+"      --every <Number>         Keep one frame in N\n"
+"      --fps <Number>           Keep N frames per second of video\n"
+"      --start <Position>       Skip frames before this position\n"
+"      --end <Position>         Stop at this position (exclusive)\n"
+"      --keyframes-only         Keep key frames only (needs FFmpeg)\n"
+"      --dedup <Bits>           Skip frames whose 64-bit perceptual hash\n"
+"                               differs from the last written frame in\n"
+"                               fewer than N bits (e.g. 3)\n"
+"\n"
+"A position is a frame number (150), seconds (12.5s)\n"
+"or a time ([HH:]MM:SS[.mmm]).\n"
 "\n";
 
-int parse_quality(const char* str) {
-  // check quality format: [0-9]+
+// A frame number or a time from the start of the video.
+typedef struct {
+  bool set;
+  bool is_time;
+  double value;  // frame number, or milliseconds
+} Position;
+
+typedef struct {
+  int quality;
+  int jobs;
+  int every;            // keep one frame in N; 0 keeps all
+  double fps;           // keep F frames per second; 0 keeps all
+  Position start;
+  Position end;
+  bool keyframes_only;
+  int dedup_bits;       // near-duplicate threshold; 0 writes all frames
+  bool pack;            // write a frame pack instead of JPEG files
+} Config;
+
+// Jump with a seek instead of grabbing frames when the next wanted
+// frame is further away than this many seconds of video.
+static const double kSeekSeconds = 2.0;
+
+int parse_number(const char* str) {
+  // check number format: [0-9]+
   for (size_t i = 0, len = strlen(str); i < len; ++i) {
     if (!isdigit(str[i])) {  // bad format
       return -1;
@@ -29,88 +86,501 @@ int parse_quality(const char* str) {
   return atoi(str);
 }
 
-void unpack_video(const char* video_file, const char* image_dir, int quality) {
+// Parse "150", "12.5s" or "[HH:]MM:SS[.mmm]".
+bool parse_position(const char* str, Position* pos) {
+  char* end = nullptr;
+  pos->set = true;
+  if (strchr(str, ':') != nullptr) {
+    double ms = 0;
+    const char* p = str;
+    while (true) {
+      double v = strtod(p, &end);
+      if (end == p || v < 0) {
+        return false;
+      }
+
+      ms = ms * 60 + v * 1000;
+      if (*end == '\0') {
+        break;
+      } else if (*end != ':') {
+        return false;
+      }
+
+      p = end + 1;
+    }
+
+    pos->is_time = true;
+    pos->value = ms;
+    return true;
+  }
+
+  double v = strtod(str, &end);
+  if (end == str || v < 0) {
+    return false;
+  }
+
+  if (strcmp(end, "s") == 0) {
+    pos->is_time = true;
+    pos->value = v * 1000;
+    return true;
+  }
+
+  pos->is_time = false;
+  pos->value = v;
+  return *end == '\0' && parse_number(str) >= 0;
+}
+
+// Decides which frames are kept. Frame numbers count from 0 at the
+// start of the video, as CAP_PROP_POS_FRAMES does.
+class FrameSelector {
+ public:
+  FrameSelector(const Config& config, double video_fps, long first)
+      : first_(first), step_(1), use_keyframes_(false) {
+    if (config.every > 0) {
+      step_ = config.every;
+    } else if (config.fps > 0 && video_fps > config.fps) {
+      step_ = video_fps / config.fps;
+    }
+  }
+
+  // Restrict the selection to these frames, in increasing order.
+  void set_keyframes(const std::vector<long>& keyframes) {
+    keyframes_ = keyframes;
+    use_keyframes_ = true;
+  }
+
+  // The first frame at or after cur that should be kept, or -1.
+  long next(long cur) const {
+    if (cur < first_) {
+      cur = first_;
+    }
+
+    if (use_keyframes_) {
+      auto it = std::lower_bound(keyframes_.begin(), keyframes_.end(), cur);
+      return it == keyframes_.end() ? -1 : *it;
+    }
+
+    // the k-th kept frame is first + round(k * step)
+    long k = static_cast<long>(ceil((cur - first_) / step_ - 1e-9));
+    long frame = first_ + lround(k * step_);
+    while (frame < cur) {
+      frame = first_ + lround(++k * step_);
+    }
+
+    return frame;
+  }
+
+ private:
+  long first_;
+  double step_;
+  bool use_keyframes_;
+  std::vector<long> keyframes_;
+};
+
+// A decoded frame on its way to an encoder task.
+typedef struct {
+  unsigned int index;
+  double time_ms;
+  cv::Mat image;
+} Frame;
+
+// Decode on the calling thread and encode each frame as a task on the
+// pool. At most `in_flight` frames are decoded but not yet written;
+// their buffers come back through a bounded queue and are reused by
+// cap.read(), so memory use is fixed. While no buffer is free, the
+// decoder runs queued tasks itself instead of waiting. File names come
+// from the decode order, so the output does not depend on which encoder
+// finishes first. In pack mode, output is the pack file and encoded
+// frames are appended to it as they come.
+// Returns 0, or the exit code of the failure: 2 for input, 3 for output.
+int unpack_video(const char* video_file, const char* output,
+                 const Config& config, ThreadPool* pool, size_t in_flight) {
   cv::VideoCapture cap(video_file);  // open the video file
   if (!cap.isOpened()) {  // check if we succeeded
     fprintf(stderr, "Error: failed to open video file: %s\n", video_file);
-    exit(2);
+    return 2;
   }
 
-  std::vector<int> imwrite_params = {cv::IMWRITE_JPEG_QUALITY, quality};
+  double video_fps = cap.get(cv::CAP_PROP_FPS);
+  if (config.fps > 0 && video_fps <= 0) {
+    fprintf(stderr, "Error: unknown frame rate: %s\n", video_file);
+    return 2;
+  }
 
-  for (unsigned int i = 0; ; ++i) {
-    cv::Mat frame;
-    cap >> frame;  // read a new frame
-    if (frame.empty()) {
-        break;
+  FramePackWriter pack;
+  if (config.pack && !pack.open(output)) {
+    return 3;
+  }
+
+  const std::vector<int> imwrite_params = {cv::IMWRITE_JPEG_QUALITY,
+                                           config.quality};
+
+  BoundedQueue<cv::Mat> free_images(in_flight);
+  for (size_t i = 0; i < in_flight; ++i) {
+    free_images.push(cv::Mat());
+  }
+
+  // Any frame in flight is either queued, and run_pending() finds it, or
+  // being encoded, and its buffer comes back soon; blocking is safe then.
+  auto take_buffer = [&](cv::Mat* image) {
+    while (!free_images.try_pop(image)) {
+      if (!pool->run_pending()) {
+        return free_images.pop(image);
+      }
+    }
+
+    return true;
+  };
+
+  std::atomic<bool> failed(false);
+  auto write_image = [&](const Frame& frame, std::vector<uchar>* buf) {
+    if (config.pack) {
+      return cv::imencode(".jpg", frame.image, *buf, imwrite_params) &&
+             pack.append(frame.index, frame.time_ms, buf->data(),
+                         buf->size());
     }
 
     char image_path[1024];
     snprintf(image_path, sizeof(image_path),
-             "%s/%08u.jpg", image_dir, i);
+             "%s/%08u.jpg", output, frame.index);
 
-    bool ok = cv::imwrite(image_path, frame, imwrite_params);
+    bool ok = cv::imwrite(image_path, frame.image, imwrite_params);
     if (ok) {
       printf("%s\n", image_path);
       fflush(stdout);
     } else {
       fprintf(stderr, "Error: failed to write %s\n", image_path);
-      exit(3);
     }
+
+    return ok;
+  };
+
+  auto encode = [&](Frame* frame) {
+    static thread_local std::vector<uchar> buf;  // reused by each thread
+    if (!failed && !write_image(*frame, &buf)) {
+      failed = true;
+    }
+
+    free_images.push(std::move(frame->image));
+  };
+
+  const long seek_distance = video_fps > 0 ? kSeekSeconds * video_fps : 64;
+
+  long cur = 0;  // number of the next frame the capture returns
+  long first = 0;
+  if (config.start.set && config.start.is_time) {
+    cap.set(cv::CAP_PROP_POS_MSEC, config.start.value);
+    cur = first = static_cast<long>(cap.get(cv::CAP_PROP_POS_FRAMES));
+  } else if (config.start.set) {
+    first = static_cast<long>(config.start.value);
+  }
+
+  FrameSelector selector(config, video_fps, first);
+  if (config.keyframes_only) {
+    std::vector<FrameEntry> entries;
+    if (!scan_video_frames(video_file, &entries)) {
+      return 2;
+    }
+
+    std::vector<long> keyframes;
+    for (size_t i = 0; i < entries.size(); ++i) {
+      if (entries[i].keyframe) {
+        keyframes.push_back(i);
+      }
+    }
+
+    selector.set_keyframes(keyframes);
+  }
+
+  long kept = 0;
+  long skipped = 0;
+  uint64_t last_hash = 0;
+  while (!failed) {
+    long next = selector.next(cur);
+    if (next < 0) {
+      break;
+    } else if (config.end.set && !config.end.is_time &&
+               next >= config.end.value) {
+      break;
+    }
+
+    // Frames in between are either jumped over or grabbed without
+    // retrieve(), which skips their color conversion and copy.
+    if (next - cur > seek_distance) {
+      cap.set(cv::CAP_PROP_POS_FRAMES, next);
+      cur = static_cast<long>(cap.get(cv::CAP_PROP_POS_FRAMES));
+    }
+
+    bool ok = true;
+    while (cur < next && (ok = cap.grab())) {
+      ++cur;
+    }
+
+    if (!ok) {
+      break;
+    }
+
+    Frame frame;
+    frame.index = cur;
+    take_buffer(&frame.image);
+    cap >> frame.image;  // read a new frame, reusing the buffer
+    if (frame.image.empty()) {
+      free_images.push(std::move(frame.image));
+      break;
+    }
+
+    ++cur;
+    frame.time_ms = cap.get(cv::CAP_PROP_POS_MSEC);
+    if (config.end.set && config.end.is_time &&
+        frame.time_ms >= config.end.value) {
+      free_images.push(std::move(frame.image));
+      break;
+    }
+
+    // Drop near duplicates of the last written frame before the far more
+    // expensive JPEG encoding.
+    if (config.dedup_bits > 0) {
+      uint64_t hash = frame_dhash(frame.image);
+      if (kept > 0 && hash_distance(hash, last_hash) < config.dedup_bits) {
+        ++skipped;
+        free_images.push(std::move(frame.image));
+        continue;
+      }
+
+      last_hash = hash;
+    }
+
+    ++kept;
+    pool->submit([&encode, frame]() mutable { encode(&frame); });
+  }
+
+  // every buffer back means every frame has been written; the encoders
+  // touch nothing of this call after they give their buffer back
+  for (size_t i = 0; i < in_flight; ++i) {
+    cv::Mat image;
+    take_buffer(&image);
   }
 
   cap.release();
+  if (config.pack) {
+    if (!pack.close()) {
+      failed = true;
+    } else {
+      printf("Packed %zu frames into %s\n", pack.size(), output);
+    }
+  }
+
+  if (failed) {
+    return 3;
+  }
+
+  if (config.dedup_bits > 0) {
+    fprintf(stderr, "Skipped %ld near-duplicate frames from %s, wrote %ld\n",
+            skipped, video_file, kept);
+  }
+
+  return 0;
+}
+
+// The file name of a path without its directory and extension.
+static std::string video_name(const char* path) {
+  std::string name = path;
+  size_t slash = name.find_last_of('/');
+  if (slash != std::string::npos) {
+    name = name.substr(slash + 1);
+  }
+
+  size_t dot = name.find_last_of('.');
+  if (dot != std::string::npos && dot > 0) {
+    name = name.substr(0, dot);
+  }
+
+  return name;
+}
+
+// Unpack many videos with config.jobs threads in all. Each video is a
+// task that decodes on a pool thread and submits its frames as tasks to
+// the same pool, so idle threads pick up the encoding of whichever video
+// has work. OpenCV's own parallel loops are limited to the calling
+// thread, so that they do not add threads on top of the pool.
+int unpack_batch(const char* output_dir, char** video_files, int count,
+                 const Config& config) {
+  // Every video gets an output named after it, so two videos with the
+  // same name in different directories would write to the same place.
+  std::set<std::string> names;
+  for (int i = 0; i < count; ++i) {
+    if (!names.insert(video_name(video_files[i])).second) {
+      fprintf(stderr, "Error: more than one video is named %s: %s\n",
+              video_name(video_files[i]).c_str(), video_files[i]);
+      return 2;
+    }
+  }
+
+  // declared before the pool, so it outlives the tasks that update it
+  std::atomic<int> failures(0);
+  cv::setNumThreads(1);
+  ThreadPool pool(config.jobs);
+
+  // about 2 * jobs + 1 frames in flight in all, as in single-video mode,
+  // shared by the videos that run at the same time
+  const size_t running = std::min(count, config.jobs);
+  const size_t in_flight =
+      std::max<size_t>(3, (2 * config.jobs + running) / running);
+
+  for (int i = 0; i < count; ++i) {
+    const char* video_file = video_files[i];
+    std::string output = std::string(output_dir) + "/" +
+                         video_name(video_file);
+    if (config.pack) {
+      output += ".pack";
+    } else if (mkdir(output.c_str(), 0755) != 0 && errno != EEXIST) {
+      fprintf(stderr, "Error: cannot create %s: %s\n", output.c_str(),
+              strerror(errno));
+      ++failures;
+      continue;
+    }
+
+    if (output.size() > 1000) {
+      fprintf(stderr, "Error: output path is too long: %s\n",
+              output.c_str());
+      ++failures;
+      continue;
+    }
+
+    pool.submit_top_level([&, video_file, output] {
+      if (unpack_video(video_file, output.c_str(), config, &pool,
+                       in_flight) != 0) {
+        ++failures;
+      }
+    });
+  }
+
+  pool.wait();
+  fprintf(stderr, "Unpacked %d of %d videos\n", count - failures.load(),
+          count);
+  return failures.load() == 0 ? 0 : 2;
 }
 
 int main(int argc, char** argv) {
   int show_help = 0;
   int show_version = 0;
-  int quality = 95;
+  Config config = {95, 1, 0, 0, {false, false, 0}, {false, false, 0}, false,
+                   0, false};
+  const char* batch_dir = nullptr;
 
   static struct option long_options[] = {
     {"help", no_argument, &show_help, 'h'},
     {"version", no_argument, &show_version, 'v'},
     {"quality", required_argument, 0, 'Q'},
+    {"jobs", required_argument, 0, 'j'},
+    {"pack", no_argument, 0, 'P'},
+    {"batch", required_argument, 0, 'b'},
+    {"every", required_argument, 0, 0},
+    {"fps", required_argument, 0, 0},
+    {"start", required_argument, 0, 0},
+    {"end", required_argument, 0, 0},
+    {"keyframes-only", no_argument, 0, 0},
+    {"dedup", required_argument, 0, 0},
     {0, 0, 0, 0}
   };
 
   while (true) {
-    int opt = getopt_long(argc, argv, "hvQ:", long_options, nullptr);
+    int opt_index = 0;
+    int opt = getopt_long(argc, argv, "hvQ:j:Pb:", long_options, &opt_index);
     if (opt == -1) {
       break;
+    } else if (opt == 0) {
+      const char* name = long_options[opt_index].name;
+      if (strcmp(name, "every") == 0) {
+        config.every = parse_number(optarg);
+        if (config.every < 1) {
+          fprintf(stderr, "Error: invalid frame interval: %s\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+      } else if (strcmp(name, "fps") == 0) {
+        config.fps = atof(optarg);
+        if (config.fps <= 0) {
+          fprintf(stderr, "Error: invalid frame rate: %s\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+      } else if (strcmp(name, "start") == 0) {
+        if (!parse_position(optarg, &config.start)) {
+          fprintf(stderr, "Error: invalid start position: %s\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+      } else if (strcmp(name, "end") == 0) {
+        if (!parse_position(optarg, &config.end)) {
+          fprintf(stderr, "Error: invalid end position: %s\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+      } else if (strcmp(name, "keyframes-only") == 0) {
+        config.keyframes_only = true;
+      } else if (strcmp(name, "dedup") == 0) {
+        config.dedup_bits = parse_number(optarg);
+        if (config.dedup_bits < 1 || config.dedup_bits > 64) {
+          fprintf(stderr, "Error: invalid dedup threshold: %s\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+      }
     } else if (opt == 'h') {
-      printf(usage, program);
+      printf(usage, program, program, program);
       exit(EXIT_SUCCESS);
     } else if (opt == 'v') {
       printf("%s version %s\n", program, version);
       exit(EXIT_SUCCESS);
     } else if (opt == 'Q') {
-      quality = parse_quality(optarg);
-      if (quality < 0 || quality > 100) {
+      config.quality = parse_number(optarg);
+      if (config.quality < 0 || config.quality > 100) {
         fprintf(stderr, "Error: invalid quality. "
                 "It should be between [0, 100]\n");
         exit(EXIT_FAILURE);
       }
+    } else if (opt == 'P') {
+      config.pack = true;
+    } else if (opt == 'b') {
+      batch_dir = optarg;
+    } else if (opt == 'j') {
+      config.jobs = parse_number(optarg);
+      if (config.jobs < 1) {
+        fprintf(stderr, "Error: invalid number of jobs: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
     } else {  // 'h'
-      fprintf(stderr, usage, program);
+      fprintf(stderr, usage, program, program, program);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if ((config.every > 0) + (config.fps > 0) + config.keyframes_only > 1) {
+    fprintf(stderr, "Error: --every, --fps and --keyframes-only "
+            "cannot be combined\n");
+    exit(EXIT_FAILURE);
+  }
+
+  if (batch_dir != nullptr) {
+    if (argc - optind < 1) {
+      fprintf(stderr, usage, program, program, program);
       exit(EXIT_FAILURE);
     }
+
+    return unpack_batch(batch_dir, argv + optind, argc - optind, config);
   }
 
   if (argc - optind != 2) {
-    fprintf(stderr, usage, program);
+    fprintf(stderr, usage, program, program, program);
     exit(EXIT_FAILURE);
   }
 
   const char* video_file = argv[optind++];
-  const char* image_dir = argv[optind++];
+  const char* output = argv[optind++];
 
-  if (strlen(image_dir) > 1000) {
+  if (strlen(output) > 1000) {
     fprintf(stderr, "Error: image_dir is too long\n");
     exit(EXIT_FAILURE);
   }
 
-  unpack_video(video_file, image_dir, quality);
-
-  return 0;
+  // the calling thread decodes; the pool threads encode
+  ThreadPool pool(config.jobs);
+  return unpack_video(video_file, output, config, &pool,
+                      2 * config.jobs + 1);
 }
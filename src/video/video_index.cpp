@@ -0,0 +1,84 @@
+// Frame lists straight from the container, using FFmpeg's demuxer.
+// Refer to:
+// https://ffmpeg.org/doxygen/trunk/group__lavf__decoding.html
+
+#include <stdio.h>
+#include <algorithm>
+#include <vector>
+#include "video_index.h"
+
+#ifdef HAVE_FFMPEG
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+
+bool scan_video_frames(const char* video_file,
+                       std::vector<FrameEntry>* frames) {
+#if LIBAVFORMAT_VERSION_INT < AV_VERSION_INT(58, 9, 100)
+  av_register_all();
+#endif
+
+  AVFormatContext* fmt = nullptr;
+  if (avformat_open_input(&fmt, video_file, nullptr, nullptr) < 0) {
+    fprintf(stderr, "Error: cannot demux %s\n", video_file);
+    return false;
+  }
+
+  if (avformat_find_stream_info(fmt, nullptr) < 0) {
+    fprintf(stderr, "Error: no stream info in %s\n", video_file);
+    avformat_close_input(&fmt);
+    return false;
+  }
+
+  int stream = av_find_best_stream(fmt, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+  if (stream < 0) {
+    fprintf(stderr, "Error: no video stream in %s\n", video_file);
+    avformat_close_input(&fmt);
+    return false;
+  }
+
+  frames->clear();
+  AVPacket* pkt = av_packet_alloc();
+  while (av_read_frame(fmt, pkt) >= 0) {
+    if (pkt->stream_index == stream) {
+      FrameEntry entry;
+      entry.pts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+      entry.time_ms = 0;
+      entry.keyframe = (pkt->flags & AV_PKT_FLAG_KEY) != 0;
+      frames->push_back(entry);
+    }
+
+    av_packet_unref(pkt);
+  }
+
+  av_packet_free(&pkt);
+
+  // packets come in decoding order; frames are returned in presentation order
+  std::stable_sort(frames->begin(), frames->end(),
+                   [](const FrameEntry& a, const FrameEntry& b) {
+                     return a.pts < b.pts;
+                   });
+
+  if (!frames->empty()) {
+    const double ms_per_tick = av_q2d(fmt->streams[stream]->time_base) * 1000;
+    const int64_t first_pts = frames->front().pts;
+    for (auto& entry : *frames) {
+      entry.time_ms = (entry.pts - first_pts) * ms_per_tick;
+    }
+  }
+
+  avformat_close_input(&fmt);
+  return true;
+}
+
+#else
+
+bool scan_video_frames(const char* video_file,
+                       std::vector<FrameEntry>* frames) {
+  fprintf(stderr, "Error: cannot index %s: built without FFmpeg\n",
+          video_file);
+  return false;
+}
+
+#endif  // HAVE_FFMPEG
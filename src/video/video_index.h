@@ -0,0 +1,22 @@
+#ifndef _VIDEO_INDEX_H_
+#define _VIDEO_INDEX_H_
+
+#include <stdint.h>
+#include <vector>
+
+// One video frame, as seen by the demuxer.
+typedef struct {
+  int64_t pts;     // presentation timestamp, in stream time base units
+  double time_ms;  // presentation time from the first frame
+  bool keyframe;
+} FrameEntry;
+
+// Read the packets of the best video stream of a file, without decoding
+// them, and list one entry per frame in presentation order, so that
+// frames[i] describes what cv::VideoCapture returns as frame i.
+// Returns false if the file cannot be demuxed, or if this build has no
+// FFmpeg support.
+bool scan_video_frames(const char* video_file,
+                       std::vector<FrameEntry>* frames);
+
+#endif  // _VIDEO_INDEX_H_
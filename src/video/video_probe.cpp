@@ -0,0 +1,187 @@
+// Copyright: This program is released into the public domain.
+
+// Print the properties of many video files, one JSON object per line,
+// probing them in parallel. Replaces python/video/video_props.py.
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "json_string.h"
+#include "video_props.h"
+
+static const char* program = "video_probe";
+static const char* version = "0.1.0";
+static const char* usage =
+"Usage: %s [options] file1 [file2 ...]\n"
+"\n"
+"Prints one JSON object per file, in the order given.\n"
+"\n"
+"Options:\n"
+"  -h, --help                   Print this help message and exit\n"
+"  -v, --version                Print version message and exit\n"
+"  -j, --jobs <Number>          Files probed at once (default: twice the\n"
+"                               number of CPUs)\n"
+"  -l, --list <File>            Also probe the files listed in File, one\n"
+"                               per line; - reads the list from stdin\n"
+"\n";
+
+// Sets *ok to whether the file could be probed; the JSON has an "error"
+// member otherwise.
+static std::string probe_to_json(const std::string& file, bool* ok) {
+  std::string json = "{\"file\": ";
+  append_json_string(&json, file);
+
+  VideoProps props;
+  *ok = probe_video(file.c_str(), &props);
+  if (!*ok) {
+    json += ", \"error\": \"cannot open\"}";
+    return json;
+  }
+
+  char buf[256];
+  snprintf(buf, sizeof(buf), ", \"fps\": %.3f, \"frame_count\": %ld, "
+           "\"width\": %d, \"height\": %d, \"fourcc\": ", props.fps,
+           props.frame_count, props.width, props.height);
+  json += buf;
+  append_json_string(&json, props.fourcc);
+  json += ", \"codec\": ";
+  append_json_string(&json, props.codec);
+  json += ", \"source\": ";
+  append_json_string(&json, props.source);
+  json += "}";
+  return json;
+}
+
+static bool read_list(const char* list_file, std::vector<std::string>* files) {
+  FILE* f = strcmp(list_file, "-") == 0 ? stdin : fopen(list_file, "r");
+  if (f == nullptr) {
+    fprintf(stderr, "Error: cannot open %s\n", list_file);
+    return false;
+  }
+
+  char line[4096];
+  while (fgets(line, sizeof(line), f) != nullptr) {
+    size_t n = strlen(line);
+    while (n > 0 && (line[n - 1] == '\n' || line[n - 1] == '\r')) {
+      line[--n] = '\0';
+    }
+
+    if (n > 0) {
+      files->push_back(line);
+    }
+  }
+
+  if (f != stdin) {
+    fclose(f);
+  }
+
+  return true;
+}
+
+int main(int argc, char** argv) {
+  int show_help = 0;
+  int show_version = 0;
+  int jobs = 2 * std::max(1u, std::thread::hardware_concurrency());
+  std::vector<std::string> files;
+
+  static struct option long_options[] = {
+    {"help", no_argument, &show_help, 'h'},
+    {"version", no_argument, &show_version, 'v'},
+    {"jobs", required_argument, 0, 'j'},
+    {"list", required_argument, 0, 'l'},
+    {0, 0, 0, 0}
+  };
+
+  while (true) {
+    int opt = getopt_long(argc, argv, "hvj:l:", long_options, nullptr);
+    if (opt == -1) {
+      break;
+    } else if (opt == 'h') {
+      printf(usage, program);
+      exit(EXIT_SUCCESS);
+    } else if (opt == 'v') {
+      printf("%s version %s\n", program, version);
+      exit(EXIT_SUCCESS);
+    } else if (opt == 'j') {
+      jobs = atoi(optarg);
+      if (jobs < 1) {
+        fprintf(stderr, "Error: invalid number of jobs: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+    } else if (opt == 'l') {
+      if (!read_list(optarg, &files)) {
+        exit(2);
+      }
+    } else {  // 'h'
+      fprintf(stderr, usage, program);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  for (int i = optind; i < argc; ++i) {
+    files.push_back(argv[i]);
+  }
+
+  if (files.empty()) {
+    fprintf(stderr, usage, program);
+    exit(EXIT_FAILURE);
+  }
+
+  // Workers take files in order and leave the result in their slot; the
+  // main thread prints each line as soon as the ones before it are done.
+  std::vector<std::string> results(files.size());
+  std::vector<bool> done(files.size(), false);
+  std::vector<bool> probed(files.size(), false);
+  std::mutex mutex;
+  std::condition_variable finished;
+  std::atomic<size_t> next(0);
+
+  auto worker = [&] {
+    while (true) {
+      size_t i = next++;
+      if (i >= files.size()) {
+        break;
+      }
+
+      bool ok;
+      std::string json = probe_to_json(files[i], &ok);
+      std::lock_guard<std::mutex> lock(mutex);
+      results[i].swap(json);
+      probed[i] = ok;
+      done[i] = true;
+      finished.notify_one();
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < jobs && i < static_cast<int>(files.size()); ++i) {
+    threads.push_back(std::thread(worker));
+  }
+
+  int failed = 0;
+  for (size_t i = 0; i < files.size(); ++i) {
+    std::string json;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      finished.wait(lock, [&] { return done[i]; });
+      json.swap(results[i]);
+      failed += !probed[i];
+    }
+
+    puts(json.c_str());
+  }
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  return failed == 0 ? 0 : 2;
+}
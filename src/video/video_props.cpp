@@ -0,0 +1,123 @@
+// Video properties, from the container header when FFmpeg is available.
+// Refer to:
+// https://ffmpeg.org/doxygen/trunk/group__lavf__decoding.html
+
+#include <math.h>
+#include <stdio.h>
+#include <mutex>
+#include <string>
+#include <opencv2/opencv.hpp>
+#include "video_props.h"
+
+#ifdef HAVE_FFMPEG
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+#endif
+
+std::string fourcc_to_string(uint32_t fourcc) {
+  char buf[5] = {0, 0, 0, 0, 0};
+  buf[0] = static_cast<char>(fourcc & 0xff);
+  buf[1] = static_cast<char>((fourcc >> 8) & 0xff);
+  buf[2] = static_cast<char>((fourcc >> 16) & 0xff);
+  buf[3] = static_cast<char>((fourcc >> 24) & 0xff);
+  return buf;
+}
+
+void read_capture_props(cv::VideoCapture* cap, VideoProps* props) {
+  props->fps = cap->get(cv::CAP_PROP_FPS);
+  props->fourcc =
+      fourcc_to_string(static_cast<uint32_t>(cap->get(cv::CAP_PROP_FOURCC)));
+  props->codec.clear();
+  props->frame_count = static_cast<long>(cap->get(cv::CAP_PROP_FRAME_COUNT));
+  props->width = static_cast<int>(cap->get(cv::CAP_PROP_FRAME_WIDTH));
+  props->height = static_cast<int>(cap->get(cv::CAP_PROP_FRAME_HEIGHT));
+  props->source = "capture";
+}
+
+#ifdef HAVE_FFMPEG
+
+static double frame_rate(const AVStream* st) {
+  if (st->avg_frame_rate.num > 0 && st->avg_frame_rate.den > 0) {
+    return av_q2d(st->avg_frame_rate);
+  }
+
+  if (st->r_frame_rate.num > 0 && st->r_frame_rate.den > 0) {
+    return av_q2d(st->r_frame_rate);
+  }
+
+  return 0;
+}
+
+static const AVStream* find_video_stream(AVFormatContext* fmt) {
+  int stream = av_find_best_stream(fmt, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+  return stream >= 0 ? fmt->streams[stream] : nullptr;
+}
+
+static bool probe_with_ffmpeg(const char* video_file, VideoProps* props) {
+#if LIBAVFORMAT_VERSION_INT < AV_VERSION_INT(58, 9, 100)
+  static std::once_flag registered;
+  std::call_once(registered, [] { av_register_all(); });
+#endif
+
+  AVFormatContext* fmt = nullptr;
+  if (avformat_open_input(&fmt, video_file, nullptr, nullptr) < 0) {
+    return false;
+  }
+
+  // most containers describe their streams in the header; the others
+  // need a look at the first packets, which opens the decoders
+  props->source = "header";
+  const AVStream* st = find_video_stream(fmt);
+  if (st == nullptr || st->codecpar->width <= 0 || frame_rate(st) <= 0) {
+    if (avformat_find_stream_info(fmt, nullptr) < 0 ||
+        (st = find_video_stream(fmt)) == nullptr) {
+      avformat_close_input(&fmt);
+      return false;
+    }
+
+    props->source = "streams";
+  }
+
+  const AVCodecParameters* par = st->codecpar;
+  props->fps = frame_rate(st);
+  props->fourcc = fourcc_to_string(par->codec_tag);
+  props->codec = avcodec_get_name(par->codec_id);
+  props->width = par->width;
+  props->height = par->height;
+
+  // like VideoCapture, estimate the count from the duration if need be
+  props->frame_count = static_cast<long>(st->nb_frames);
+  if (props->frame_count <= 0) {
+    double seconds = 0;
+    if (st->duration != AV_NOPTS_VALUE) {
+      seconds = st->duration * av_q2d(st->time_base);
+    } else if (fmt->duration != AV_NOPTS_VALUE) {
+      seconds = static_cast<double>(fmt->duration) / AV_TIME_BASE;
+    }
+
+    props->frame_count = static_cast<long>(floor(seconds * props->fps + 0.5));
+  }
+
+  avformat_close_input(&fmt);
+  return true;
+}
+
+#endif  // HAVE_FFMPEG
+
+bool probe_video(const char* video_file, VideoProps* props) {
+#ifdef HAVE_FFMPEG
+  if (probe_with_ffmpeg(video_file, props)) {
+    return true;
+  }
+#endif
+
+  cv::VideoCapture cap(video_file);
+  if (!cap.isOpened()) {
+    return false;
+  }
+
+  read_capture_props(&cap, props);
+  return true;
+}
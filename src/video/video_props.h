@@ -0,0 +1,32 @@
+#ifndef _VIDEO_PROPS_H_
+#define _VIDEO_PROPS_H_
+
+#include <stdint.h>
+#include <string>
+#include <opencv2/opencv.hpp>
+
+// The basic properties of a video, as cv::VideoCapture reports them.
+typedef struct {
+  double fps;
+  std::string fourcc;  // e.g. "avc1"; may be empty or unprintable
+  std::string codec;   // decoder name, e.g. "h264"; empty if unknown
+  long frame_count;    // may be estimated from the duration
+  int width;
+  int height;
+  const char* source;  // how they were obtained: "header", "streams"
+                       // or "capture"
+} VideoProps;
+
+// Turn CAP_PROP_FOURCC into its 4 characters.
+std::string fourcc_to_string(uint32_t fourcc);
+
+// Read the properties of an open capture.
+void read_capture_props(cv::VideoCapture* cap, VideoProps* props);
+
+// Probe a video file as cheaply as possible. With FFmpeg, the container
+// header is read without opening any decoder; the streams are analyzed
+// only when the header leaves the size or frame rate unknown. Otherwise,
+// or if FFmpeg cannot open the file, it falls back to a VideoCapture.
+bool probe_video(const char* video_file, VideoProps* props);
+
+#endif  // _VIDEO_PROPS_H_